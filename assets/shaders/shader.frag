@@ -1,10 +1,63 @@
 #version 450
 
 layout(location = 0) in vec3 frag_color;
+layout(location = 1) in vec3 frag_position;
+layout(location = 2) in vec3 frag_normal;
 
 layout(location = 0) out vec4 out_color;
 
+struct PointLight
+{
+	vec4 position_radius;
+	vec4 color_intensity;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer LightBuffer
+{
+	PointLight lights[];
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer ClusterBuffer
+{
+	uvec2 clusters[];
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer LightIndexBuffer
+{
+	uint light_indices[];
+};
+
+layout(push_constant) uniform Constants
+{
+	uvec4 cluster_count;
+	vec2 cluster_size;		// In pixels
+} constants;
+
+const vec3 AMBIENT = vec3(0.05);
+
 void main()
 {
-	out_color = vec4(frag_color, 1.0);
-}
\ No newline at end of file
+	// Same grid as cluster.comp, gl_FragCoord.z is the NDC depth
+	uvec3 cluster_count = constants.cluster_count.xyz;
+	uvec3 cluster = min(uvec3(gl_FragCoord.xy / constants.cluster_size, gl_FragCoord.z * float(cluster_count.z)), cluster_count - 1);
+	uvec2 range = clusters[cluster.x + cluster.y * cluster_count.x + cluster.z * cluster_count.x * cluster_count.y];
+
+	vec3 normal = normalize(frag_normal);
+	vec3 lighting = AMBIENT;
+
+	for (uint i = 0; i < range.y; i++)
+	{
+		PointLight light = lights[light_indices[range.x + i]];
+
+		vec3 to_light = light.position_radius.xyz - frag_position;
+		float distance = length(to_light);
+
+		// Smooth falloff to zero at the light's radius
+		float falloff = clamp(1.0 - pow(distance / light.position_radius.w, 2.0), 0.0, 1.0);
+		float diffuse = max(dot(normal, to_light / max(distance, 1.0e-4)), 0.0);
+
+		lighting += light.color_intensity.rgb * light.color_intensity.w * diffuse * falloff * falloff;
+	}
+
+	out_color = vec4(frag_color * lighting, 1.0);
+}
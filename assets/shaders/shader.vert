@@ -1,6 +1,11 @@
 #version 450
 
+// Per-instance world matrix, occupies locations 0-3
+layout(location = 0) in mat4 instance_transform;
+
 layout(location = 0) out vec3 frag_color;
+layout(location = 1) out vec3 frag_position;
+layout(location = 2) out vec3 frag_normal;
 
 vec2 positions[3] = vec2[](
 	vec2(0.0, -0.5),
@@ -16,6 +21,10 @@ vec3 colors[3] = vec3[](
 
 void main()
 {
-	gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+	vec4 position = instance_transform * vec4(positions[gl_VertexIndex], 0.0, 1.0);
+
+	gl_Position = position;
 	frag_color = colors[gl_VertexIndex];
-}
\ No newline at end of file
+	frag_position = position.xyz;
+	frag_normal = mat3(instance_transform) * vec3(0.0, 0.0, -1.0);
+}
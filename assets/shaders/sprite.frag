@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) in vec2 frag_tex_coord;
+layout(location = 1) in vec4 frag_color;
+
+layout(location = 0) out vec4 out_color;
+
+layout(set = 0, binding = 0) uniform sampler2D sprite_texture;
+
+void main()
+{
+	out_color = texture(sprite_texture, frag_tex_coord) * frag_color;
+}
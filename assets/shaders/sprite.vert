@@ -0,0 +1,20 @@
+#version 450
+
+layout(location = 0) in vec2 position;		// Pixels, origin in the top left corner
+layout(location = 1) in vec2 tex_coord;
+layout(location = 2) in vec4 color;
+
+layout(location = 0) out vec2 frag_tex_coord;
+layout(location = 1) out vec4 frag_color;
+
+layout(push_constant) uniform Constants
+{
+	vec2 inverse_half_extent;	// 2 / swapchain size
+} constants;
+
+void main()
+{
+	gl_Position = vec4(position * constants.inverse_half_extent - 1.0, 0.0, 1.0);
+	frag_tex_coord = tex_coord;
+	frag_color = color;
+}
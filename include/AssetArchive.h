@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Packed asset archive written by the offline AssetPacker tool (tools/AssetPacker.cpp).
+//
+// Layout: AssetArchiveHeader | AssetArchiveEntry[EntryCount] | names | aligned entry data
+//
+// Entries are sorted by name hash so lookups are a binary search over the mapped table.
+// Stored entries are handed out as views into the mapping, compressed entries (LZ4 or Zstd,
+// enabled with ASSET_ARCHIVE_LZ4 / ASSET_ARCHIVE_ZSTD) are decompressed into caller storage.
+
+constexpr uint32_t ASSET_ARCHIVE_MAGIC = 0x4B415056;	// "VPAK"
+constexpr uint32_t ASSET_ARCHIVE_VERSION = 1;
+constexpr uint32_t ASSET_ARCHIVE_ALIGNMENT = 64;
+
+enum class AssetCompression : uint32_t
+{
+	None = 0,
+	LZ4 = 1,
+	Zstd = 2,
+};
+
+struct AssetArchiveHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t EntryCount;
+	uint32_t Alignment;
+	uint64_t EntryOffset;
+	uint64_t NameOffset;
+	uint64_t NameSize;
+};
+
+struct AssetArchiveEntry
+{
+	uint64_t NameHash;
+	uint32_t NameOffset;	// Relative to AssetArchiveHeader::NameOffset
+	uint32_t NameLength;
+	uint64_t Offset;
+	uint64_t Size;			// Size in the archive
+	uint64_t UncompressedSize;
+	AssetCompression Compression;
+	uint32_t Reserved;
+};
+
+// FNV-1a, asset names use '/' as separator
+constexpr uint64_t HashAssetName(std::string_view name)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	for (char c : name)
+	{
+		hash ^= static_cast<uint8_t>(c);
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+class AssetArchive
+{
+public:
+	AssetArchive() = default;
+	AssetArchive(const std::string& filename);
+
+	void Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen() const { return m_File.IsOpen(); }
+	uint32_t GetEntryCount() const { return m_Header ? m_Header->EntryCount : 0; }
+	const AssetArchiveEntry& GetEntry(uint32_t index) const { return m_Entries[index]; }
+	std::string_view GetName(const AssetArchiveEntry& entry) const;
+
+	const AssetArchiveEntry* Find(std::string_view name) const;
+	bool Contains(std::string_view name) const { return Find(name) != nullptr; }
+
+	// Returns a view of the entry's contents. Uncompressed entries point into the mapping and
+	// storage is left untouched, compressed entries are decompressed into storage.
+	std::span<const uint8_t> Load(std::string_view name, std::vector<uint8_t>& storage) const;
+	std::span<const uint8_t> Load(const AssetArchiveEntry& entry, std::vector<uint8_t>& storage) const;
+
+private:
+	MappedFile m_File;
+	const AssetArchiveHeader* m_Header = nullptr;
+	const AssetArchiveEntry* m_Entries = nullptr;
+	const char* m_Names = nullptr;
+};
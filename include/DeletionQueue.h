@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+enum class DeletionType : uint32_t
+{
+	Buffer,
+	Image,
+	ImageView,
+	Sampler,
+	Memory,
+	Pipeline,
+	PipelineLayout,
+	DescriptorPool,
+	DescriptorSetLayout,
+	ShaderModule,
+	Framebuffer,
+	RenderPass,
+	QueryPool,
+};
+
+struct DeletionQueueStats
+{
+	uint64_t QueueDepth = 0;		// Handles waiting for the GPU
+	uint64_t PeakQueueDepth = 0;
+	uint64_t PendingBytes = 0;		// Device memory waiting to be freed
+	uint64_t ReleasedCount = 0;
+	uint64_t DestroyedCount = 0;
+	uint64_t ReclaimedBytes = 0;
+	uint64_t BatchCount = 0;		// Flushes that destroyed anything
+};
+
+// Defers the destruction of Vulkan handles until the GPU is done with them. Every released
+// handle is tagged with the current retire value (the frame or timeline value that last used it), Flush
+// destroys everything up to the value the GPU is known to have finished. Values are
+// expected to grow, a smaller one released later just waits for the ones before it.
+class DeletionQueue
+{
+public:
+	DeletionQueue() = default;
+
+	DeletionQueue(const DeletionQueue&) = delete;
+	DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+	void Init(VkDevice device, const VkAllocationCallbacks* allocator);
+
+	// Handles released from now on are destroyed once value has completed
+	void SetRetireValue(uint64_t value);
+	uint64_t GetRetireValue() const { return m_RetireValue; }
+
+	// Memory can be null, size is what gets reported as reclaimed
+	void ReleaseBuffer(VkBuffer buffer, VkDeviceMemory memory = VK_NULL_HANDLE, VkDeviceSize size = 0);
+	void ReleaseImage(VkImage image, VkDeviceMemory memory = VK_NULL_HANDLE, VkDeviceSize size = 0);
+	void ReleaseMemory(VkDeviceMemory memory, VkDeviceSize size);
+	void ReleaseImageView(VkImageView image_view) { Push(DeletionType::ImageView, image_view, 0); }
+	void ReleaseSampler(VkSampler sampler) { Push(DeletionType::Sampler, sampler, 0); }
+	void ReleasePipeline(VkPipeline pipeline) { Push(DeletionType::Pipeline, pipeline, 0); }
+	void ReleasePipelineLayout(VkPipelineLayout layout) { Push(DeletionType::PipelineLayout, layout, 0); }
+	void ReleaseDescriptorPool(VkDescriptorPool pool) { Push(DeletionType::DescriptorPool, pool, 0); }
+	void ReleaseDescriptorSetLayout(VkDescriptorSetLayout layout) { Push(DeletionType::DescriptorSetLayout, layout, 0); }
+	void ReleaseShaderModule(VkShaderModule shader_module) { Push(DeletionType::ShaderModule, shader_module, 0); }
+	void ReleaseFramebuffer(VkFramebuffer framebuffer) { Push(DeletionType::Framebuffer, framebuffer, 0); }
+	void ReleaseRenderPass(VkRenderPass render_pass) { Push(DeletionType::RenderPass, render_pass, 0); }
+	void ReleaseQueryPool(VkQueryPool pool) { Push(DeletionType::QueryPool, pool, 0); }
+
+	// Destroys every handle whose retire value is at most completed_value, in one batch
+	void Flush(uint64_t completed_value);
+
+	// Destroys everything, only valid once the device is idle
+	void FlushAll() { Flush(UINT64_MAX); }
+
+	DeletionQueueStats GetStats() const;
+
+private:
+	struct Entry
+	{
+		uint64_t RetireValue;
+		uint64_t Handle;
+		VkDeviceSize Size;
+		DeletionType Type;
+	};
+
+	// Non-dispatchable handles are pointers on 64 bit and uint64_t on 32 bit platforms
+	template<typename T>
+	void Push(DeletionType type, T handle, VkDeviceSize size)
+	{
+		if constexpr (std::is_pointer_v<T>)
+			PushEntry(type, reinterpret_cast<uintptr_t>(handle), size);
+		else
+			PushEntry(type, static_cast<uint64_t>(handle), size);
+	}
+
+	void PushEntry(DeletionType type, uint64_t handle, VkDeviceSize size);
+	void Destroy(const Entry& entry);
+
+private:
+	VkDevice m_Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* m_Allocator = nullptr;
+
+	mutable std::mutex m_Mutex;
+	std::deque<Entry> m_Entries;
+	std::vector<Entry> m_Batch;		// Storage reused by Flush, only touched under the lock
+	uint64_t m_RetireValue = 0;
+
+	DeletionQueueStats m_Stats;
+};
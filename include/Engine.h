@@ -1,9 +1,25 @@
 #pragma once
 
+#include <chrono>
+#include <mutex>
+#include <span>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <vulkan/vulkan.h>
 
+#include "AssetArchive.h"
+#include "DeletionQueue.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+#include "MemoryBudget.h"
+#include "MeshFormat.h"
+#include "ResidencyManager.h"
+#include "Scene.h"
+#include "SpriteBatcher.h"
+#include "TimelineQueue.h"
+#include "Tracer.h"
+
 struct SDL_Window;
 
 struct EngineSpecification
@@ -11,6 +27,217 @@ struct EngineSpecification
 	std::string Name = "Vulkan Renderer";
 	uint32_t Width = 1600;
 	uint32_t Height = 900;
+
+	// Capacity of the per-instance buffer, the scene can't hold more objects than this
+	uint32_t MaxInstances = 262144;
+
+	// Packed assets, loose files below "assets/" are used when the archive doesn't exist
+	std::string AssetArchivePath = "assets.pak";
+
+	// Point lights of the demo scene, the light buffer holds at most MaxLights
+	uint32_t LightCount = 1024;
+	uint32_t MaxLights = 16384;
+
+	// Frames measured per light count by the lighting benchmark, off when 0. The count starts at
+	// LightCount and doubles up to MaxLights, shutdown prints a row for each.
+	uint32_t LightBenchmarkFrames = 0;
+
+	// Quads the streamed sprite vertex buffers hold per frame, the rest is dropped
+	uint32_t MaxSprites = 65536;
+
+	// Random quads drawn on top of the HUD every frame to stress the sprite path
+	uint32_t SpriteBenchmarkCount = 0;
+
+	// Share of a heap's budget the engine fills before evicting least recently used meshes
+	float MemoryBudgetFraction = 0.9f;
+
+	// Mesh loaded ResidencyStressCopies times after startup. Its heap's target only fits half of
+	// the copies and a quarter of them is requested every frame, so meshes keep getting evicted
+	// and restored. Off when empty.
+	std::string ResidencyStressMesh;
+	uint32_t ResidencyStressCopies = 16;
+
+	// Frames and uploads synchronize on VK_KHR_timeline_semaphore, fences when this is off or
+	// the device doesn't support it
+	bool TimelineSemaphores = true;
+
+	// Chrome trace of the CPU and GPU zones, written on shutdown. Tracing is off when empty.
+	std::string TracePath;
+};
+
+// Mesh uploaded from a binary mesh file, all LODs share one vertex and index buffer
+struct GpuMesh
+{
+	std::string Name;
+	uint32_t ResidencyId = INVALID_RESIDENCY_ID;
+
+	// Retire value of the frame copying a restored mesh, UINT64_MAX until that frame is recorded
+	uint64_t RestoreValue = 0;
+
+	VkBuffer		VertexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	VertexMemory = VK_NULL_HANDLE;
+	VkBuffer		IndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	IndexMemory = VK_NULL_HANDLE;
+
+	VkDeviceSize VertexBufferSize = 0;
+	VkDeviceSize IndexBufferSize = 0;
+
+	uint32_t VertexCount = 0;
+	float BoundsMin[3] = {};
+	float BoundsMax[3] = {};
+	std::vector<MeshFileLod> Lods;
+};
+
+struct StartupStats
+{
+	uint32_t TaskCount = 0;
+	uint32_t ThreadCount = 0;
+	double TaskMs = 0.0;			// All startup tasks back to back
+	double CriticalPathMs = 0.0;	// Longest chain of dependent tasks
+	double InitMs = 0.0;
+	double FirstFrameMs = 0.0;		// From Init until the first frame was queued for presentation
+};
+
+struct OcclusionCullingStats
+{
+	uint32_t Instances = 0;
+	uint32_t FrustumCulled = 0;
+	uint32_t VisibleEarly = 0;		// Drawn after testing against the previous frame's Hi-Z
+	uint32_t Disoccluded = 0;		// Drawn after re-testing against this frame's Hi-Z
+	uint32_t OccludedEarly = 0;
+	uint32_t Occluded = 0;			// Culled by occlusion in the end
+};
+
+struct PointLight
+{
+	float Position[3] = { 0.0f, 0.0f, 0.0f };
+	float Radius = 1.0f;
+	float Color[3] = { 1.0f, 1.0f, 1.0f };
+	float Intensity = 1.0f;
+};
+
+static_assert(sizeof(PointLight) == 32, "PointLight has to match the light buffer layout.");
+
+struct LightingStats
+{
+	uint32_t LightCount = 0;
+	uint32_t ClusterCount = 0;
+	uint32_t LightIndexCount = 0;	// Sum of the lights of all clusters
+	uint32_t MaxClusterLights = 0;
+	uint32_t OverflowCount = 0;		// Lights dropped from full clusters
+	double AssignmentMs = 0.0;		// GPU time of the light assignment pass
+	double FrameMs = 0.0;			// GPU time of the whole frame
+
+	uint64_t FrameCount = 0;
+	double AccumulatedAssignmentMs = 0.0;
+	double AccumulatedFrameMs = 0.0;
+};
+
+// One light count of the lighting benchmark
+struct LightingBenchmarkRow
+{
+	uint32_t LightCount = 0;
+	uint32_t MaxClusterLights = 0;
+	uint32_t OverflowCount = 0;
+
+	uint64_t FrameCount = 0;
+	double AccumulatedAssignmentMs = 0.0;
+	double AccumulatedFrameMs = 0.0;
+};
+
+// Driver host allocations of the last frame, split by where they happened
+struct HostAllocationFrameStats
+{
+	uint64_t ResetCommandBuffer = 0;
+	uint64_t RecordCommandBuffer = 0;
+	uint64_t SubmitAndPresent = 0;
+	uint64_t Frame = 0;
+
+	uint64_t FrameCount = 0;
+	uint64_t AccumulatedFrame = 0;
+};
+
+// Host time spent waiting for a frame slot to be free again, fence waits and resets or
+// timeline waits
+struct FrameSyncStats
+{
+	bool Timeline = false;
+	uint64_t FrameCount = 0;
+	uint64_t CallCount = 0;			// Vulkan synchronization calls
+	double LastMs = 0.0;
+	double AccumulatedMs = 0.0;
+};
+
+// Sampled texture of the 2D overlay, bound per sprite batch
+struct SpriteTexture
+{
+	VkImage			Image = VK_NULL_HANDLE;
+	VkDeviceMemory	Memory = VK_NULL_HANDLE;
+	VkImageView		ImageView = VK_NULL_HANDLE;
+	VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+};
+
+// Per frame in flight resources of the clustered lighting
+struct LightingFrame
+{
+	VkBuffer		LightBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	LightMemory = VK_NULL_HANDLE;
+	void*			LightMapped = nullptr;
+
+	VkBuffer		ClusterBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	ClusterMemory = VK_NULL_HANDLE;
+	VkBuffer		LightIndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	LightIndexMemory = VK_NULL_HANDLE;
+	VkBuffer		ClusterDataBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	ClusterDataMemory = VK_NULL_HANDLE;
+
+	VkBuffer		ReadbackBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	ReadbackMemory = VK_NULL_HANDLE;
+	void*			ReadbackMapped = nullptr;
+
+	VkQueryPool		TimestampPool = VK_NULL_HANDLE;
+	VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+	uint32_t		LightCount = 0;
+	bool			Submitted = false;
+};
+
+// Per frame in flight resources of the occlusion culling passes
+struct CullingFrame
+{
+	VkBuffer		BoundsBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	BoundsMemory = VK_NULL_HANDLE;
+	void*			BoundsMapped = nullptr;
+
+	VkBuffer		VisibleBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	VisibleMemory = VK_NULL_HANDLE;
+	VkBuffer		DrawDataBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	DrawDataMemory = VK_NULL_HANDLE;
+	VkBuffer		StateBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	StateMemory = VK_NULL_HANDLE;
+
+	VkBuffer		ReadbackBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory	ReadbackMemory = VK_NULL_HANDLE;
+	void*			ReadbackMapped = nullptr;
+
+	VkDescriptorSet DescriptorSet = VK_NULL_HANDLE;
+	bool			Submitted = false;
+};
+
+// One time command buffer from the shared command pool, holds the pool's lock until
+// EndSingleTimeCommands submitted it. Going out of scope before that (an exception while
+// recording) frees the buffer and unlocks.
+struct SingleTimeCommands
+{
+	SingleTimeCommands(std::mutex& mutex, VkDevice device, VkCommandPool pool);
+	~SingleTimeCommands();
+
+	SingleTimeCommands(const SingleTimeCommands&) = delete;
+	SingleTimeCommands& operator=(const SingleTimeCommands&) = delete;
+
+	std::unique_lock<std::mutex> Lock;
+	VkDevice Device = VK_NULL_HANDLE;
+	VkCommandPool Pool = VK_NULL_HANDLE;
+	VkCommandBuffer Buffer = VK_NULL_HANDLE;
 };
 
 class Engine
@@ -24,30 +251,117 @@ public:
 	void Run();
 
 	SDL_Window* GetWindowHandle() const { return m_WindowHandle; };
+	Scene& GetScene() { return m_Scene; }
+
+	// Returns the contents of an asset (path relative to "assets/"), zero-copy when it's stored
+	// uncompressed in the asset archive. Otherwise storage holds the data.
+	std::span<const uint8_t> LoadAsset(const std::string& name, std::vector<uint8_t>& storage);
+
+	// Uploads a mesh written by the MeshOptimizer tool to device local memory
+	uint32_t LoadMesh(const std::string& name);
+	const GpuMesh& GetMesh(uint32_t mesh) const { return m_Meshes[mesh]; }
+
+	// Frees the mesh's buffers once the frames in flight are done with them, the index stays reserved
+	// and requesting it again throws
+	void UnloadMesh(uint32_t mesh);
+
+	// Marks the mesh as used this frame. An evicted mesh is copied again by the next frame without
+	// waiting for it, null is returned until that frame finished on the GPU.
+	const GpuMesh* RequestMesh(uint32_t mesh);
+
+	// Per-heap budget and usage, refreshed every frame
+	const MemoryBudget& GetMemoryBudget() const { return m_MemoryBudget; }
+	const ResidencyStats& GetResidencyStats() const { return m_Residency.GetStats(); }
+
+	// Destroys released handles once the last frame that could use them has finished on the GPU
+	DeletionQueue& GetDeletionQueue() { return m_DeletionQueue; }
+
+	// Not initialized without VK_KHR_timeline_semaphore, frames are fenced then
+	TimelineQueue& GetTimelineQueue() { return m_TimelineQueue; }
+	const FrameSyncStats& GetFrameSyncStats() const { return m_FrameSyncStats; }
+
+	const OcclusionCullingStats& GetCullingStats() const { return m_CullingStats; }
+
+	// Uploaded every frame, only the first MaxLights are used
+	std::vector<PointLight>& GetLights() { return m_Lights; }
+	const LightingStats& GetLightingStats() const { return m_LightingStats; }
+
+	// Immediate mode 2D quads, drawn on top of the scene in the frame they were submitted in
+	SpriteBatcher& GetSpriteBatcher() { return m_SpriteBatcher; }
+
+	// Texture from RGBA8 pixels for SpriteQuad::Texture, texture 0 is plain white
+	uint32_t CreateSpriteTexture(uint32_t width, uint32_t height, const uint8_t* pixels);
+
+	const StartupStats& GetStartupStats() const { return m_StartupStats; }
+
+	// Every Vulkan object is created with the tracking host allocator
+	HostAllocatorStats GetHostAllocatorStats() const { return m_HostAllocator.GetStats(); }
+	const HostAllocationFrameStats& GetHostAllocationFrameStats() const { return m_HostFrameStats; }
 
 private:
 	void Init();
 	void Shutdown();
+	void OpenAssetArchive();
 	void CreateVulkanInstance();
 	void SetupSDL();
 	void CreateSDLSurface();
 	void SetupVulkan();
 	void CreateVulkanRenderPass();
+	void CreateVulkanDepthResources();
+	void CreateVulkanLightingResources();
 	void CreateVulkanGraphicsPipeline();
 	void CreateVulkanFramebuffers();
 	void CreateVulkanCommandPool();
 	void CreateVulkanCommandBuffers();
 	void CreateVulkanSyncObjects();
+	void CreateVulkanInstanceBuffers();
+	void CreateVulkanCullingResources();
+	void CreateVulkanSpriteResources();
+	void CreateScene();
+	void CreateLights();
+
+	void UpdateScene();
+	void UpdateLights();
+	void RecordLightBenchmark();
+	void UpdateOverlay();
+
+	void UploadMesh(uint32_t mesh, bool deferred);
+	void RecordMeshCopies(VkCommandBuffer buffer);
+	void EvictMesh(uint32_t mesh);
+	void LoadResidencyStress();
+	void RequestResidencyStress();
+
+	void CalibrateGpuClock();
+	uint64_t GpuTicksToHostTime(uint64_t ticks) const;
+
+	void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory);
+	SingleTimeCommands BeginSingleTimeCommands();
+	void EndSingleTimeCommands(SingleTimeCommands& commands);
+	void CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory);
+	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t base_mip, uint32_t mip_count);
+	VkShaderModule CreateShaderModule(const std::string& name);
 
 	void RecordCommandBuffer(VkCommandBuffer buffer, uint32_t image_index);
+	void RecordScenePass(VkCommandBuffer buffer, uint32_t image_index, VkRenderPass render_pass, VkDeviceSize draw_offset);
+	void RecordLightAssignment(VkCommandBuffer buffer);
+	void RecordHiZBuild(VkCommandBuffer buffer);
+	void RecordOcclusionCulling(VkCommandBuffer buffer, uint32_t phase);
+	void RecordSprites(VkCommandBuffer buffer);
+	void ReadCullingStats();
+	void ReadLightingStats();
 	void RenderFrame();
 
 private:
 	EngineSpecification m_Specification;
 	SDL_Window* m_WindowHandle = nullptr;
 
+	HostAllocator m_HostAllocator;
+	const VkAllocationCallbacks* m_Allocator = m_HostAllocator.GetCallbacks();
+	HostAllocationFrameStats m_HostFrameStats;
+
 	std::vector<const char*> m_SDLExtensions;
 	uint32_t m_SDLExtensionCount;
+	bool m_HasPhysicalDeviceProperties2 = false;
 
 	VkInstance				m_Instance = VK_NULL_HANDLE;
 	VkSurfaceKHR			m_Surface = VK_NULL_HANDLE;
@@ -60,6 +374,7 @@ private:
 	VkExtent2D				m_SwapchainExtent;
 	VkPipelineLayout		m_PipelineLayout = VK_NULL_HANDLE;
 	VkRenderPass			m_Renderpass = VK_NULL_HANDLE;
+	VkRenderPass			m_RenderpassLate = VK_NULL_HANDLE;
 	VkPipeline				m_Pipeline = VK_NULL_HANDLE;
 	VkCommandPool			m_CommandPool = VK_NULL_HANDLE;
 
@@ -68,9 +383,129 @@ private:
 	std::vector<VkSemaphore>		m_SemaphoresRenderFinished;
 	std::vector<VkFence>			m_FencesInFlight;
 
+	// Frame counter value submitted with each fence, and the newest one known to be finished
+	std::vector<uint64_t>			m_FenceFrames;
+	uint64_t						m_CompletedFrame = 0;
+	DeletionQueue					m_DeletionQueue;
+
+	// Replaces the fences when available, the deletion queue then retires by timeline value
+	TimelineQueue					m_TimelineQueue;
+	std::vector<uint64_t>			m_FramePoints;
+	FrameSyncStats					m_FrameSyncStats;
+
+	MemoryBudget		m_MemoryBudget;
+	ResidencyManager	m_Residency;
+
 	std::vector<VkImage>		m_SwapchainImages;
 	std::vector<VkImageView>	m_SwapchainImageViews;
 	std::vector<VkFramebuffer>	m_SwapchainFramebuffers;
 
+	VkImage			m_DepthImage = VK_NULL_HANDLE;
+	VkDeviceMemory	m_DepthImageMemory = VK_NULL_HANDLE;
+	VkImageView		m_DepthImageView = VK_NULL_HANDLE;
+
+	// Hi-Z pyramid, farthest depth per texel
+	VkImage						m_HiZImage = VK_NULL_HANDLE;
+	VkDeviceMemory				m_HiZImageMemory = VK_NULL_HANDLE;
+	VkImageView					m_HiZImageView = VK_NULL_HANDLE;
+	std::vector<VkImageView>	m_HiZMipViews;
+	std::vector<VkDescriptorSet> m_HiZDescriptorSets;
+	VkExtent2D					m_HiZExtent = {};
+	uint32_t					m_HiZMipCount = 0;
+	VkSampler					m_HiZSampler = VK_NULL_HANDLE;
+	bool						m_HiZValid = false;
+
+	VkDescriptorPool		m_DescriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSetLayout	m_HiZSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout		m_HiZPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline				m_HiZPipeline = VK_NULL_HANDLE;
+	VkDescriptorSetLayout	m_CullSetLayout = VK_NULL_HANDLE;
+	VkPipelineLayout		m_CullPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline				m_CullPipeline = VK_NULL_HANDLE;
+
+	std::vector<CullingFrame>	m_CullingFrames;
+	OcclusionCullingStats		m_CullingStats;
+
+	// Clustered lighting, the light lists are built by a compute pass and read by the fragment shader
+	VkDescriptorSetLayout	m_LightingSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool		m_LightingDescriptorPool = VK_NULL_HANDLE;
+	VkPipelineLayout		m_ClusterPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline				m_ClusterPipeline = VK_NULL_HANDLE;
+	uint32_t				m_ClusterCount[3] = {};
+	float					m_TimestampPeriod = 1.0f;
+
+	// Maps GPU timestamps onto the tracer's host clock, without VK_EXT_calibrated_timestamps
+	// the clocks are correlated once at startup
+	PFN_vkGetCalibratedTimestampsEXT m_GetCalibratedTimestamps = nullptr;
+	VkTimeDomainEXT			m_HostTimeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+	uint64_t				m_CalibrationGpuTicks = 0;
+	uint64_t				m_CalibrationHostTime = 0;
+
+	std::vector<LightingFrame>	m_LightingFrames;
+	std::vector<PointLight>		m_Lights;
+	LightingStats				m_LightingStats;
+
+	// Light count currently measured by the benchmark, rows in the order they were measured
+	uint32_t							m_LightBenchmarkCount = 0;
+	std::vector<LightingBenchmarkRow>	m_LightBenchmarkRows;
+
+	// Batched 2D overlay, one indexed draw per batch from a vertex buffer streamed every frame
+	VkDescriptorSetLayout	m_SpriteSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool		m_SpriteDescriptorPool = VK_NULL_HANDLE;
+	VkSampler				m_SpriteSampler = VK_NULL_HANDLE;
+	VkPipelineLayout		m_SpritePipelineLayout = VK_NULL_HANDLE;
+	VkPipeline				m_SpritePipelines[SPRITE_BLEND_COUNT] = {};
+	VkBuffer				m_SpriteIndexBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory			m_SpriteIndexMemory = VK_NULL_HANDLE;
+
+	std::vector<VkBuffer>		m_SpriteVertexBuffers;
+	std::vector<VkDeviceMemory>	m_SpriteVertexMemory;
+	std::vector<void*>			m_SpriteVertexMapped;
+	std::vector<SpriteTexture>	m_SpriteTextures;
+	SpriteBatcher				m_SpriteBatcher;
+
+	// GPU frame times shown by the HUD graph, oldest first from the cursor on
+	std::vector<float>	m_FrameTimeHistory;
+	uint32_t			m_FrameTimeCursor = 0;
+
+	// The demo scene is placed directly in clip space
+	float m_ViewProjection[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+	std::vector<VkBuffer>		m_InstanceBuffers;
+	std::vector<VkDeviceMemory>	m_InstanceBufferMemory;
+	std::vector<void*>			m_InstanceBufferMapped;
+
+	AssetArchive m_AssetArchive;
+	std::vector<GpuMesh> m_Meshes;
+	std::vector<uint32_t> m_StressMeshes;
+
+	// Restores waiting for the next frame's command buffer
+	struct MeshCopy
+	{
+		uint32_t Mesh;
+		VkBuffer StagingBuffer;
+		VkDeviceMemory StagingMemory;
+		VkDeviceSize StagingSize;
+	};
+
+	std::vector<MeshCopy> m_MeshCopies;
+
+	// SPIR-V read ahead by the startup graph, empty once Init is done
+	struct ShaderCode
+	{
+		std::vector<uint8_t> Storage;
+		std::span<const uint8_t> Code;
+	};
+
+	std::unordered_map<std::string, ShaderCode> m_ShaderCode;
+	std::mutex m_SingleTimeCommandsMutex;
+
+	std::chrono::high_resolution_clock::time_point m_StartupTime;
+	StartupStats m_StartupStats;
+
+	JobSystem m_JobSystem;
+	Scene m_Scene;
+	uint64_t m_FrameCounter = 0;
+
 	uint32_t m_CurrentFrame = 0;
 };
\ No newline at end of file
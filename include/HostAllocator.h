@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Command, object, cache, device and instance
+constexpr uint32_t HOST_ALLOCATION_SCOPE_COUNT = 5;
+
+// Size of the per-thread arena serving command scope allocations
+constexpr size_t HOST_ARENA_SIZE = 256 * 1024;
+
+struct HostAllocationScopeStats
+{
+	uint64_t AllocationCount = 0;
+	uint64_t ReallocationCount = 0;
+	uint64_t FreeCount = 0;
+	uint64_t AllocatedBytes = 0;	// Sum over all allocations so far
+	uint64_t CurrentBytes = 0;
+	uint64_t PeakBytes = 0;
+
+	// Allocations the driver made on its own and only reported (pfnInternalAllocation)
+	uint64_t InternalAllocationCount = 0;
+	uint64_t InternalBytes = 0;
+};
+
+struct HostAllocatorStats
+{
+	HostAllocationScopeStats Scopes[HOST_ALLOCATION_SCOPE_COUNT];
+
+	uint64_t ArenaAllocationCount = 0;
+	uint64_t ArenaFallbackCount = 0;	// Command scope allocations that didn't fit into the arena
+	uint64_t ArenaCount = 0;
+
+	uint64_t GetAllocationCount() const;
+	uint64_t GetAllocatedBytes() const;
+};
+
+const char* GetHostAllocationScopeName(uint32_t scope);
+
+// VkAllocationCallbacks that track every driver host allocation per VkSystemAllocationScope.
+// Command scope allocations only live for the duration of one Vulkan command and are served
+// from a bump arena owned by the calling thread, everything else goes to the aligned heap.
+// All callbacks are thread safe, the counters are relaxed atomics.
+class HostAllocator
+{
+public:
+	HostAllocator();
+	~HostAllocator();
+
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	const VkAllocationCallbacks* GetCallbacks() const { return &m_Callbacks; }
+
+	// Snapshot of the counters, cheap enough to take every frame
+	HostAllocatorStats GetStats() const;
+	uint64_t GetAllocationCount() const;
+
+private:
+	struct Arena;
+	struct ScopeCounters
+	{
+		std::atomic<uint64_t> AllocationCount{ 0 };
+		std::atomic<uint64_t> ReallocationCount{ 0 };
+		std::atomic<uint64_t> FreeCount{ 0 };
+		std::atomic<uint64_t> AllocatedBytes{ 0 };
+		std::atomic<uint64_t> CurrentBytes{ 0 };
+		std::atomic<uint64_t> PeakBytes{ 0 };
+		std::atomic<uint64_t> InternalAllocationCount{ 0 };
+		std::atomic<uint64_t> InternalBytes{ 0 };
+	};
+
+	static void* VKAPI_PTR Allocate(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void* VKAPI_PTR Reallocate(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+	static void VKAPI_PTR Free(void* user_data, void* memory);
+	static void VKAPI_PTR InternalAllocation(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+	static void VKAPI_PTR InternalFree(void* user_data, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+
+	void* AllocateTracked(size_t size, size_t alignment, uint32_t scope);
+	void FreeTracked(void* memory);
+	Arena* GetThreadArena();
+
+private:
+	VkAllocationCallbacks m_Callbacks = {};
+	uint64_t m_Id = 0;
+
+	ScopeCounters m_Scopes[HOST_ALLOCATION_SCOPE_COUNT];
+	std::atomic<uint64_t> m_ArenaAllocationCount{ 0 };
+	std::atomic<uint64_t> m_ArenaFallbackCount{ 0 };
+
+	// Arenas of every thread that made command scope allocations, freed with the allocator
+	mutable std::mutex m_ArenaMutex;
+	std::vector<Arena*> m_Arenas;
+};
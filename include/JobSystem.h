@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem
+{
+public:
+	// A worker count of 0 uses one worker per hardware thread (minus the calling thread)
+	JobSystem(uint32_t worker_count = 0);
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Splits [0, count) into batches of batch_size and runs function(begin, end) on the
+	// workers and the calling thread. Returns once every batch has finished.
+	void ParallelFor(uint32_t count, uint32_t batch_size, const std::function<void(uint32_t, uint32_t)>& function);
+
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()) + 1; }
+
+private:
+	void WorkerLoop();
+	void RunBatches(const std::function<void(uint32_t, uint32_t)>& function, uint32_t count, uint32_t batch_size);
+
+private:
+	std::vector<std::thread> m_Workers;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_WakeCondition;
+	std::condition_variable m_DoneCondition;
+
+	const std::function<void(uint32_t, uint32_t)>* m_Function = nullptr;
+	uint32_t m_Count = 0;
+	uint32_t m_BatchSize = 0;
+	uint32_t m_Generation = 0;
+	uint32_t m_ActiveWorkers = 0;
+	bool m_Quit = false;
+
+	std::atomic<uint32_t> m_NextBatch{ 0 };
+};
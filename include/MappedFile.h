@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Whether [offset, offset + length) lies within size bytes, without overflowing on untrusted values
+inline bool IsFileRangeValid(uint64_t offset, uint64_t length, uint64_t size)
+{
+	return offset <= size && length <= size - offset;
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const std::string& filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+
+	void Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen() const { return m_Data != nullptr; }
+	const uint8_t* GetData() const { return m_Data; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	const uint8_t* m_Data = nullptr;
+	size_t m_Size = 0;
+
+#ifdef _WIN32
+	void* m_FileHandle = nullptr;
+	void* m_MappingHandle = nullptr;
+#endif
+};
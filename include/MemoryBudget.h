@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+// Share of a heap's size assumed to be available when VK_EXT_memory_budget isn't, the rest is
+// left to other processes and the driver
+constexpr float MEMORY_BUDGET_FALLBACK_FRACTION = 0.8f;
+
+struct MemoryHeapBudget
+{
+	VkDeviceSize Size = 0;
+	VkDeviceSize Budget = 0;		// What the process can allocate before the driver starts paging
+	VkDeviceSize Usage = 0;			// Whole process with VK_EXT_memory_budget, tracked allocations otherwise
+	VkDeviceSize PeakUsage = 0;
+	VkDeviceSize TrackedUsage = 0;	// Allocations made through TrackAllocation
+	bool DeviceLocal = false;
+};
+
+// Per-heap memory budget and usage, queried through VK_EXT_memory_budget when the device
+// supports it. Without the extension the budget is a fixed fraction of the heap size and the
+// usage is what the engine allocated itself.
+class MemoryBudget
+{
+public:
+	// get_memory_properties2 is null when VK_EXT_memory_budget isn't enabled
+	void Init(VkPhysicalDevice physical_device, PFN_vkGetPhysicalDeviceMemoryProperties2KHR get_memory_properties2);
+
+	// Refreshes budget and usage of every heap, cheap enough to call every frame
+	void Update();
+
+	// Thread safe, buffers and images are created by several startup tasks at once
+	void TrackAllocation(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size);
+	void TrackFree(VkDeviceMemory memory);
+
+	bool HasBudgetExtension() const { return m_GetMemoryProperties2 != nullptr; }
+	uint32_t GetHeapCount() const { return m_MemoryProperties.memoryHeapCount; }
+	const MemoryHeapBudget& GetHeap(uint32_t heap) const { return m_Heaps[heap]; }
+
+	// Heap of a tracked allocation, UINT32_MAX when it isn't tracked
+	uint32_t GetAllocationHeap(VkDeviceMemory memory) const;
+
+private:
+	struct Allocation
+	{
+		uint32_t Heap;
+		VkDeviceSize Size;
+	};
+
+	VkPhysicalDevice m_PhysicalDevice = VK_NULL_HANDLE;
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR m_GetMemoryProperties2 = nullptr;
+
+	VkPhysicalDeviceMemoryProperties m_MemoryProperties = {};
+	MemoryHeapBudget m_Heaps[VK_MAX_MEMORY_HEAPS];
+
+	mutable std::mutex m_Mutex;
+	std::unordered_map<VkDeviceMemory, Allocation> m_Allocations;
+};
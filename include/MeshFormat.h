@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "MappedFile.h"
+
+// Binary mesh format written by the offline MeshOptimizer tool (tools/MeshOptimizer.cpp).
+// The file is meant to be memory mapped, every section is aligned so vertex and index data
+// can be copied into staging buffers without any parsing.
+//
+// Layout: MeshFileHeader | MeshFileLod[LodCount] | vertex data | index data
+
+constexpr uint32_t MESH_FILE_MAGIC = 0x48534D56;	// "VMSH"
+constexpr uint32_t MESH_FILE_VERSION = 1;
+constexpr uint32_t MESH_FILE_ALIGNMENT = 16;
+constexpr uint32_t MESH_FILE_MAX_LODS = 8;
+
+// Quantized vertex, the formats are the ones a vertex input reading it has to use
+struct MeshVertex
+{
+	uint16_t Position[4];	// VK_FORMAT_R16G16B16A16_UNORM, relative to the mesh bounds
+	int8_t Normal[4];		// VK_FORMAT_R8G8B8A8_SNORM
+	uint16_t TexCoord[2];	// VK_FORMAT_R16G16_SFLOAT
+};
+
+static_assert(sizeof(MeshVertex) == 16, "MeshVertex has to be tightly packed.");
+
+struct MeshFileHeader
+{
+	uint32_t Magic;
+	uint32_t Version;
+	uint32_t VertexStride;
+	uint32_t VertexCount;
+	uint32_t IndexCount;	// Of all LODs together, 32 bit indices
+	uint32_t LodCount;
+
+	// Dequantization: position = BoundsMin + quantized * (BoundsMax - BoundsMin)
+	float BoundsMin[3];
+	float BoundsMax[3];
+
+	uint64_t LodOffset;
+	uint64_t VertexOffset;
+	uint64_t VertexSize;
+	uint64_t IndexOffset;
+	uint64_t IndexSize;
+};
+
+// LOD 0 is the full detail mesh, all LODs share the vertex data
+struct MeshFileLod
+{
+	uint32_t FirstIndex;
+	uint32_t IndexCount;
+	float Error;			// Simplification error relative to the bounds diagonal
+	uint32_t Reserved;
+};
+
+struct MeshFileView
+{
+	const MeshFileHeader* Header = nullptr;
+	const MeshFileLod* Lods = nullptr;
+	const uint8_t* VertexData = nullptr;
+	const uint8_t* IndexData = nullptr;
+};
+
+// Validates a mapped mesh file and resolves its sections, returns false on a malformed or outdated file
+inline bool ParseMeshFile(const uint8_t* data, size_t size, MeshFileView& view)
+{
+	if (size < sizeof(MeshFileHeader))
+		return false;
+
+	const MeshFileHeader* header = reinterpret_cast<const MeshFileHeader*>(data);
+
+	if (header->Magic != MESH_FILE_MAGIC || header->Version != MESH_FILE_VERSION)
+		return false;
+
+	if (header->VertexStride != sizeof(MeshVertex) || header->LodCount == 0 || header->LodCount > MESH_FILE_MAX_LODS)
+		return false;
+
+	if (!IsFileRangeValid(header->LodOffset, static_cast<uint64_t>(header->LodCount) * sizeof(MeshFileLod), size) ||
+		!IsFileRangeValid(header->VertexOffset, header->VertexSize, size) ||
+		!IsFileRangeValid(header->IndexOffset, header->IndexSize, size))
+		return false;
+
+	// The LOD table is read in place
+	if (header->LodOffset % alignof(MeshFileLod) != 0)
+		return false;
+
+	if (header->VertexSize != static_cast<uint64_t>(header->VertexCount) * header->VertexStride ||
+		header->IndexSize != static_cast<uint64_t>(header->IndexCount) * sizeof(uint32_t))
+		return false;
+
+	view.Header = header;
+	view.Lods = reinterpret_cast<const MeshFileLod*>(data + header->LodOffset);
+	view.VertexData = data + header->VertexOffset;
+	view.IndexData = data + header->IndexOffset;
+
+	for (uint32_t i = 0; i < header->LodCount; i++)
+	{
+		if (static_cast<uint64_t>(view.Lods[i].FirstIndex) + view.Lods[i].IndexCount > header->IndexCount)
+			return false;
+	}
+
+	return true;
+}
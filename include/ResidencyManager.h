@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+class MemoryBudget;
+
+constexpr uint32_t INVALID_RESIDENCY_ID = UINT32_MAX;
+
+struct ResidencyStats
+{
+	uint32_t ResourceCount = 0;
+	uint32_t ResidentCount = 0;
+	VkDeviceSize ResidentBytes = 0;
+	VkDeviceSize PendingBytes = 0;		// Evicted, but still waiting for the GPU to release it
+
+	uint64_t EvictionCount = 0;
+	VkDeviceSize EvictedBytes = 0;
+	uint64_t RestoreCount = 0;
+
+	// Frames a heap stayed above its target because everything left was in use
+	uint64_t FramesOverBudget = 0;
+};
+
+// Keeps streamable resources in least recently used order and evicts the oldest ones of a heap
+// once its usage goes beyond a fraction of its budget. The owner does the actual eviction in the
+// callback (through the deletion queue) and restores a resource on its next use.
+class ResidencyManager
+{
+public:
+	using EvictFunction = std::function<void()>;
+
+	void SetBudgetFraction(float budget_fraction) { m_BudgetFraction = budget_fraction; }
+	float GetBudgetFraction() const { return m_BudgetFraction; }
+
+	// Caps a heap's target below the budget fraction, for oversubscribing one heap on purpose
+	void SetHeapLimit(uint32_t heap, VkDeviceSize limit) { m_HeapLimits[heap] = limit; }
+
+	// Registers a resident resource, frame is its first use
+	uint32_t Register(uint32_t heap, VkDeviceSize size, uint64_t frame, EvictFunction evict);
+	void Unregister(uint32_t resource);
+
+	// Moves the resource to the back of the eviction order
+	void Touch(uint32_t resource, uint64_t frame);
+
+	// The owner brought an evicted resource back
+	void MarkResident(uint32_t resource, uint64_t frame);
+	bool IsResident(uint32_t resource) const { return m_Resources[resource].Resident; }
+
+	// Evicts until every heap is back under its target. Resources used in frame or later stay,
+	// evictions are tagged with frame and count as released once completed_frame reaches it.
+	void Enforce(const MemoryBudget& budget, uint64_t frame, uint64_t completed_frame);
+
+	const ResidencyStats& GetStats() const { return m_Stats; }
+
+private:
+	struct Resource
+	{
+		uint32_t Heap = 0;
+		VkDeviceSize Size = 0;
+		uint64_t LastUsed = 0;
+		EvictFunction Evict;
+
+		// Least recently used list, only resident resources are linked
+		uint32_t Previous = INVALID_RESIDENCY_ID;
+		uint32_t Next = INVALID_RESIDENCY_ID;
+		bool Resident = false;
+		bool Registered = false;
+	};
+
+	struct PendingRelease
+	{
+		uint64_t Frame;
+		uint32_t Heap;
+		VkDeviceSize Size;
+	};
+
+	void Link(uint32_t resource);
+	void Unlink(uint32_t resource);
+
+private:
+	float m_BudgetFraction = 0.9f;
+	VkDeviceSize m_HeapLimits[VK_MAX_MEMORY_HEAPS] = {};		// Zero when the heap has none
+
+	std::vector<Resource> m_Resources;
+	uint32_t m_Head = INVALID_RESIDENCY_ID;	// Least recently used
+	uint32_t m_Tail = INVALID_RESIDENCY_ID;
+
+	std::deque<PendingRelease> m_PendingReleases;
+
+	ResidencyStats m_Stats;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+constexpr uint32_t INVALID_SCENE_OBJECT = UINT32_MAX;
+
+// Size of one world matrix (column major float4x4) in the per-instance buffer
+constexpr uint32_t SCENE_INSTANCE_STRIDE = 16 * sizeof(float);
+
+// Size of one world space bounding box (float4 center, float4 extents) in the GPU bounds buffer
+constexpr uint32_t SCENE_BOUNDS_STRIDE = 8 * sizeof(float);
+
+struct SceneObjectDesc
+{
+	float Position[3] = { 0.0f, 0.0f, 0.0f };
+	float Rotation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };	// Quaternion (x, y, z, w)
+	float Scale[3] = { 1.0f, 1.0f, 1.0f };
+
+	// Local space bounding box
+	float BoundsCenter[3] = { 0.0f, 0.0f, 0.0f };
+	float BoundsExtents[3] = { 0.5f, 0.5f, 0.5f };
+
+	// Parents have to be created before their children
+	uint32_t Parent = INVALID_SCENE_OBJECT;
+};
+
+struct SceneUpdateStats
+{
+	uint32_t ObjectCount = 0;
+	uint32_t ThreadCount = 0;
+	double LocalMs = 0.0;
+	double HierarchyMs = 0.0;
+	double BoundsMs = 0.0;
+	double TotalMs = 0.0;
+
+	// Objects per second and thread, averaged over all updates so far
+	double ObjectsPerSecondPerCore = 0.0;
+	uint64_t UpdateCount = 0;
+	double AccumulatedSeconds = 0.0;
+	uint64_t AccumulatedObjects = 0;
+};
+
+// Transforms, bounds and hierarchy of all scene objects, stored as structure of arrays.
+// Object indices are stable and double as instance indices on the GPU.
+class Scene
+{
+public:
+	uint32_t CreateObject(const SceneObjectDesc& desc);
+	void Clear();
+	void Reserve(uint32_t capacity);
+
+	void SetPosition(uint32_t object, float x, float y, float z);
+	void SetRotation(uint32_t object, float x, float y, float z, float w);
+	void SetScale(uint32_t object, float x, float y, float z);
+
+	// Recomputes all world matrices and world bounds. When instance_data is not null the world
+	// matrices are also written to it (SCENE_INSTANCE_STRIDE bytes per object), which is meant
+	// to be a persistently mapped GPU buffer. The same goes for bounds_data and the world bounds
+	// (SCENE_BOUNDS_STRIDE bytes per object).
+	void UpdateTransforms(JobSystem& job_system, void* instance_data, void* bounds_data = nullptr);
+
+	uint32_t GetObjectCount() const { return static_cast<uint32_t>(m_Parents.size()); }
+	const float* GetWorldMatrix(uint32_t object) const { return &m_WorldMatrices[object * 16]; }
+	const SceneUpdateStats& GetStats() const { return m_Stats; }
+
+	const std::vector<float>& GetWorldBoundsCenterX() const { return m_WorldCenterX; }
+	const std::vector<float>& GetWorldBoundsCenterY() const { return m_WorldCenterY; }
+	const std::vector<float>& GetWorldBoundsCenterZ() const { return m_WorldCenterZ; }
+	const std::vector<float>& GetWorldBoundsExtentX() const { return m_WorldExtentX; }
+	const std::vector<float>& GetWorldBoundsExtentY() const { return m_WorldExtentY; }
+	const std::vector<float>& GetWorldBoundsExtentZ() const { return m_WorldExtentZ; }
+
+private:
+	void RebuildHierarchyLevels();
+
+	void ComputeLocalMatrices(uint32_t begin, uint32_t end, float* instance_data);
+	void ComputeWorldMatrices(const uint32_t* objects, uint32_t count, float* instance_data);
+	void ComputeWorldBounds(uint32_t begin, uint32_t end, float* bounds_data);
+
+private:
+	// Local transform
+	std::vector<float> m_PositionX, m_PositionY, m_PositionZ;
+	std::vector<float> m_RotationX, m_RotationY, m_RotationZ, m_RotationW;
+	std::vector<float> m_ScaleX, m_ScaleY, m_ScaleZ;
+
+	// Bounds
+	std::vector<float> m_LocalCenterX, m_LocalCenterY, m_LocalCenterZ;
+	std::vector<float> m_LocalExtentX, m_LocalExtentY, m_LocalExtentZ;
+	std::vector<float> m_WorldCenterX, m_WorldCenterY, m_WorldCenterZ;
+	std::vector<float> m_WorldExtentX, m_WorldExtentY, m_WorldExtentZ;
+
+	// Hierarchy
+	std::vector<uint32_t> m_Parents;
+	std::vector<uint32_t> m_Depths;
+
+	// Children sorted by depth, every level can be updated in parallel once its parent level is done
+	std::vector<uint32_t> m_HierarchyOrder;
+	std::vector<uint32_t> m_LevelOffsets;
+	bool m_HierarchyDirty = false;
+
+	// Column major float4x4 per object
+	std::vector<float> m_WorldMatrices;
+
+	SceneUpdateStats m_Stats;
+};
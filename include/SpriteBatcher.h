@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class JobSystem;
+
+enum class SpriteBlend : uint8_t
+{
+	Alpha,
+	Additive,
+};
+
+constexpr uint32_t SPRITE_BLEND_COUNT = 2;
+
+constexpr uint32_t SPRITE_VERTICES_PER_QUAD = 4;
+constexpr uint32_t SPRITE_INDICES_PER_QUAD = 6;
+
+// One vertex of the streamed quad data, matches the vertex input of sprite.vert
+struct SpriteVertex
+{
+	float Position[2];		// Pixels, origin in the top left corner
+	float TexCoord[2];
+	uint32_t Color;			// RGBA8, red in the lowest byte
+};
+
+static_assert(sizeof(SpriteVertex) == 20, "SpriteVertex has to match the sprite vertex input.");
+
+struct SpriteQuad
+{
+	float Position[2] = { 0.0f, 0.0f };			// Top left corner in pixels
+	float Size[2] = { 1.0f, 1.0f };
+	float TexCoords[4] = { 0.0f, 0.0f, 1.0f, 1.0f };	// u0, v0, u1, v1
+	uint32_t Color = 0xFFFFFFFF;
+	uint32_t Texture = 0;
+	SpriteBlend Blend = SpriteBlend::Alpha;
+
+	// Layers are drawn in ascending order. Within a layer quads are grouped by blend state and
+	// texture, quads sharing both keep their submission order.
+	uint16_t Layer = 0;
+};
+
+// Quads with the same texture and blend state that are drawn with one indexed draw
+struct SpriteBatch
+{
+	uint32_t Texture = 0;
+	SpriteBlend Blend = SpriteBlend::Alpha;
+	uint32_t FirstQuad = 0;
+	uint32_t QuadCount = 0;
+};
+
+struct SpriteBatchStats
+{
+	uint32_t QuadCount = 0;
+	uint32_t DroppedCount = 0;		// Quads that didn't fit into the vertex buffer
+	uint32_t BatchCount = 0;
+	uint32_t SortPasses = 0;		// Radix passes that weren't skipped
+	double SortMs = 0.0;
+	double WriteMs = 0.0;
+	double TotalMs = 0.0;
+
+	uint64_t BuildCount = 0;
+	uint64_t AccumulatedQuads = 0;
+	double AccumulatedMs = 0.0;
+};
+
+// Immediate mode 2D batcher. Quads are collected during the frame, Build sorts them by layer,
+// blend state and texture, writes their vertices (SPRITE_VERTICES_PER_QUAD per quad, in sorted
+// order) and splits them into batches. The index data is the same for every frame, quad i uses
+// vertices 4i to 4i + 3 as two triangles (0, 1, 2) and (2, 3, 0).
+class SpriteBatcher
+{
+public:
+	void DrawQuad(const SpriteQuad& quad) { m_Quads.push_back(quad); }
+	void Reserve(uint32_t capacity);
+
+	uint32_t GetQuadCount() const { return static_cast<uint32_t>(m_Quads.size()); }
+
+	// Writes the vertices of at most max_quads quads to vertices, meant to be a persistently
+	// mapped buffer. The vertex writes are sequential per job so write-combined memory is fine.
+	// Clears the collected quads, the batches stay valid until the next Build.
+	void Build(JobSystem& job_system, SpriteVertex* vertices, uint32_t max_quads);
+
+	const std::vector<SpriteBatch>& GetBatches() const { return m_Batches; }
+	const SpriteBatchStats& GetStats() const { return m_Stats; }
+
+private:
+	void SortQuads(uint32_t quad_count);
+	void WriteVertices(uint32_t begin, uint32_t end, SpriteVertex* vertices) const;
+
+private:
+	std::vector<SpriteQuad> m_Quads;
+	std::vector<SpriteBatch> m_Batches;
+
+	// Sort keys (layer, blend, texture) and quad indices, ping-ponged by the radix passes
+	std::vector<uint64_t> m_Keys;
+	std::vector<uint64_t> m_KeysTemp;
+	std::vector<uint32_t> m_Order;
+	std::vector<uint32_t> m_OrderTemp;
+
+	SpriteBatchStats m_Stats;
+};
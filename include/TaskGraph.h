@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+enum class TaskThread
+{
+	Any,
+	Main	// The thread calling Run, for APIs like SDL's window and surface creation
+};
+
+struct TaskGraphStats
+{
+	uint32_t TaskCount = 0;
+	uint32_t ThreadCount = 0;
+	double WallMs = 0.0;
+	double TaskMs = 0.0;			// Sum of all tasks, what running them in sequence would take
+	double CriticalPathMs = 0.0;	// Longest dependency chain, the best case for any thread count
+};
+
+// Tasks with dependencies, run once on the job system's threads. Each task starts as soon as
+// the tasks it depends on finished.
+class TaskGraph
+{
+public:
+	// Dependencies are tasks added before, which keeps the graph acyclic. The name has to
+	// outlive the graph, it's used for the trace zone.
+	uint32_t AddTask(const char* name, std::function<void()> function, const std::vector<uint32_t>& dependencies = {}, TaskThread thread = TaskThread::Any);
+
+	// Returns once every task has finished. Tasks must not use the job system themselves. The
+	// first exception thrown by a task is rethrown after the running ones finished, the tasks
+	// that didn't start yet are skipped.
+	void Run(JobSystem& job_system);
+
+	const TaskGraphStats& GetStats() const { return m_Stats; }
+
+private:
+	struct Task
+	{
+		const char* Name;
+		std::function<void()> Function;
+		std::vector<uint32_t> Dependents;
+		uint32_t DependencyCount = 0;
+		uint32_t PendingDependencies = 0;
+		TaskThread Thread = TaskThread::Any;
+
+		double StartMs = 0.0;
+		double EndMs = 0.0;
+		double CriticalPathMs = 0.0;
+	};
+
+	void RunTasks();
+	bool IsFinished() const { return m_FinishedCount == m_Tasks.size() || (m_Error && m_RunningCount == 0); }
+
+private:
+	std::vector<Task> m_Tasks;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::deque<uint32_t> m_ReadyTasks;
+	std::deque<uint32_t> m_ReadyMainTasks;
+	uint32_t m_FinishedCount = 0;
+	uint32_t m_RunningCount = 0;
+	std::exception_ptr m_Error;
+
+	std::thread::id m_MainThread;
+	std::chrono::high_resolution_clock::time_point m_Start;
+
+	TaskGraphStats m_Stats;
+};
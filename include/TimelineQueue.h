@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// A value on a queue's timeline, reached once every submission up to it has finished
+struct TimelinePoint
+{
+	VkSemaphore Semaphore = VK_NULL_HANDLE;
+	uint64_t Value = 0;
+};
+
+struct TimelineSubmitInfo
+{
+	std::span<const VkCommandBuffer> CommandBuffers;
+
+	// Points of other queues, the commands wait for them at WaitPointStage
+	std::span<const TimelinePoint> WaitPoints;
+	VkPipelineStageFlags WaitPointStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+	// Binary semaphores for the swapchain, it doesn't take timeline semaphores
+	VkSemaphore WaitSemaphore = VK_NULL_HANDLE;
+	VkPipelineStageFlags WaitSemaphoreStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkSemaphore SignalSemaphore = VK_NULL_HANDLE;
+};
+
+struct TimelineQueueStats
+{
+	uint64_t SubmitCount = 0;
+	uint64_t WaitCount = 0;
+	uint64_t BlockingWaitCount = 0;		// Waits for a point not known to be reached yet
+	uint64_t CounterQueryCount = 0;
+};
+
+// Submissions on VK_KHR_timeline_semaphore. Every submit signals the next value of the queue's
+// timeline semaphore and returns it, the host polls or waits for values instead of waiting on
+// and resetting fences, and other queues wait for them with GetPoint. Not thread safe, just
+// like the queue itself.
+class TimelineQueue
+{
+public:
+	TimelineQueue() = default;
+
+	TimelineQueue(const TimelineQueue&) = delete;
+	TimelineQueue& operator=(const TimelineQueue&) = delete;
+
+	// The device needs VK_KHR_timeline_semaphore with the timelineSemaphore feature enabled
+	void Init(VkDevice device, const VkAllocationCallbacks* allocator, VkQueue queue);
+	void Destroy();
+
+	bool IsInitialized() const { return m_Semaphore != VK_NULL_HANDLE; }
+
+	// Returns the value signaled once the command buffers finished
+	uint64_t Submit(const TimelineSubmitInfo& info);
+
+	uint64_t GetLastSubmitted() const { return m_LastSubmitted; }
+	uint64_t GetNextValue() const { return m_LastSubmitted + 1; }
+	TimelinePoint GetPoint(uint64_t value) const { return { m_Semaphore, value }; }
+
+	// Newest value known to be reached without asking the driver, Poll updates it
+	uint64_t GetCompleted() const { return m_Completed; }
+	uint64_t Poll();
+	bool IsComplete(uint64_t value);
+
+	// Returns false when the timeout (in nanoseconds) ran out first
+	bool Wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+	void WaitIdle() { Wait(m_LastSubmitted); }
+
+	VkQueue GetQueue() const { return m_Queue; }
+	const TimelineQueueStats& GetStats() const { return m_Stats; }
+
+private:
+	VkDevice m_Device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* m_Allocator = nullptr;
+	VkQueue m_Queue = VK_NULL_HANDLE;
+	VkSemaphore m_Semaphore = VK_NULL_HANDLE;
+
+	PFN_vkWaitSemaphoresKHR m_WaitSemaphores = nullptr;
+	PFN_vkGetSemaphoreCounterValueKHR m_GetSemaphoreCounterValue = nullptr;
+
+	uint64_t m_LastSubmitted = 0;
+	uint64_t m_Completed = 0;
+
+	// Reused every submit, no allocations once they're big enough
+	std::vector<VkSemaphore> m_SubmitWaitSemaphores;
+	std::vector<uint64_t> m_SubmitWaitValues;
+	std::vector<VkPipelineStageFlags> m_SubmitWaitStages;
+
+	TimelineQueueStats m_Stats;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Events per chunk of a thread's trace buffer
+constexpr uint32_t TRACE_CHUNK_SIZE = 4096;
+
+struct TraceEvent
+{
+	const char* Name;	// Has to outlive the tracer, string literals or __func__
+	uint64_t Begin;		// Nanoseconds on the host clock, see Tracer::Now
+	uint64_t End;
+	bool Gpu;			// Placed on the GPU track instead of the recording thread's
+};
+
+// Collects CPU and GPU zones and writes them as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+// Every thread records into its own chunked buffer without locking, a mutex is only taken
+// the first time a thread records. Define DISABLE_TRACING to compile all zones out, otherwise
+// a disabled tracer costs one relaxed load per zone.
+class Tracer
+{
+public:
+	static Tracer& Get();
+
+	Tracer(const Tracer&) = delete;
+	Tracer& operator=(const Tracer&) = delete;
+
+	void Enable();
+	void Disable();
+
+	static bool IsEnabled()
+	{
+#ifdef DISABLE_TRACING
+		return false;
+#else
+		return s_Enabled.load(std::memory_order_relaxed);
+#endif
+	}
+
+	// CLOCK_MONOTONIC on Linux and QueryPerformanceCounter on Windows, the host time domains
+	// of VK_EXT_calibrated_timestamps. HostTicksToNanoseconds converts the raw values of those.
+	static uint64_t Now();
+	static uint64_t HostTicksToNanoseconds(uint64_t ticks);
+
+	void AddZone(const char* name, uint64_t begin, uint64_t end);
+	void AddGpuZone(const char* name, uint64_t begin, uint64_t end);
+
+	// Shown as the track name of the calling thread
+	void SetThreadName(const std::string& name);
+
+	// No thread may record while this runs, disable the tracer and stop the workers first.
+	// Returns the number of events written, throws if the file can't be created.
+	uint64_t WriteChromeTrace(const std::string& filename);
+
+private:
+	struct Chunk
+	{
+		TraceEvent Events[TRACE_CHUNK_SIZE];
+		std::atomic<uint32_t> Count{ 0 };
+		std::atomic<Chunk*> Next{ nullptr };
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t ThreadId = 0;
+		std::string Name;
+		Chunk* Head = nullptr;
+		Chunk* Tail = nullptr;		// Only touched by the owning thread
+	};
+
+	Tracer() = default;
+	~Tracer();
+
+	ThreadBuffer* GetThreadBuffer();
+	void Record(const TraceEvent& event);
+
+private:
+#ifndef DISABLE_TRACING
+	inline static std::atomic<bool> s_Enabled{ false };
+#endif
+
+	uint64_t m_StartTime = 0;
+
+	// Buffers outlive their threads so the events of finished threads are still written
+	std::mutex m_Mutex;
+	std::vector<ThreadBuffer*> m_Buffers;
+};
+
+// Records the lifetime of the enclosing scope as one zone
+class TraceScope
+{
+public:
+	explicit TraceScope(const char* name)
+		: m_Name(name), m_Begin(Tracer::IsEnabled() ? Tracer::Now() : 0)
+	{
+	}
+
+	~TraceScope()
+	{
+		if (m_Begin != 0)
+			Tracer::Get().AddZone(m_Name, m_Begin, Tracer::Now());
+	}
+
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+	const char* m_Name;
+	uint64_t m_Begin;
+};
+
+#ifndef DISABLE_TRACING
+#define TRACE_CONCAT_IMPL(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_IMPL(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_FUNCTION() ((void)0)
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vulkan/vulkan.h>
+
+inline void check_vk_result(const VkResult result)
+{
+	if (result == 0)
+	{
+		return;
+	}
+
+	throw std::runtime_error("[Vulkan] Error: VkResult = " + std::to_string(result));
+}
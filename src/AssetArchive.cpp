@@ -0,0 +1,157 @@
+#include <stdexcept>
+
+#include "AssetArchive.h"
+
+#ifdef ASSET_ARCHIVE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef ASSET_ARCHIVE_ZSTD
+#include <zstd.h>
+#endif
+
+AssetArchive::AssetArchive(const std::string& filename)
+{
+	Open(filename);
+}
+
+void AssetArchive::Open(const std::string& filename)
+{
+	Close();
+
+	m_File.Open(filename);
+
+	const uint8_t* data = m_File.GetData();
+	size_t size = m_File.GetSize();
+
+	const AssetArchiveHeader* header = reinterpret_cast<const AssetArchiveHeader*>(data);
+
+	if (size < sizeof(AssetArchiveHeader) || header->Magic != ASSET_ARCHIVE_MAGIC || header->Version != ASSET_ARCHIVE_VERSION)
+	{
+		m_File.Close();
+		throw std::runtime_error("Invalid or outdated asset archive: " + filename);
+	}
+
+	if (!IsFileRangeValid(header->EntryOffset, static_cast<uint64_t>(header->EntryCount) * sizeof(AssetArchiveEntry), size) ||
+		!IsFileRangeValid(header->NameOffset, header->NameSize, size) ||
+		header->EntryOffset % alignof(AssetArchiveEntry) != 0)
+	{
+		m_File.Close();
+		throw std::runtime_error("Truncated asset archive: " + filename);
+	}
+
+	const AssetArchiveEntry* entries = reinterpret_cast<const AssetArchiveEntry*>(data + header->EntryOffset);
+
+	for (uint32_t i = 0; i < header->EntryCount; i++)
+	{
+		if (!IsFileRangeValid(entries[i].Offset, entries[i].Size, size) || !IsFileRangeValid(entries[i].NameOffset, entries[i].NameLength, header->NameSize))
+		{
+			m_File.Close();
+			throw std::runtime_error("Truncated asset archive: " + filename);
+		}
+	}
+
+	m_Header = header;
+	m_Entries = entries;
+	m_Names = reinterpret_cast<const char*>(data + header->NameOffset);
+}
+
+void AssetArchive::Close()
+{
+	m_File.Close();
+	m_Header = nullptr;
+	m_Entries = nullptr;
+	m_Names = nullptr;
+}
+
+std::string_view AssetArchive::GetName(const AssetArchiveEntry& entry) const
+{
+	return std::string_view(m_Names + entry.NameOffset, entry.NameLength);
+}
+
+const AssetArchiveEntry* AssetArchive::Find(std::string_view name) const
+{
+	if (!m_Header)
+		return nullptr;
+
+	uint64_t hash = HashAssetName(name);
+
+	// Lower bound over the sorted hashes
+	uint32_t first = 0;
+	uint32_t count = m_Header->EntryCount;
+
+	while (count > 0)
+	{
+		uint32_t step = count / 2;
+
+		if (m_Entries[first + step].NameHash < hash)
+		{
+			first += step + 1;
+			count -= step + 1;
+		}
+		else
+		{
+			count = step;
+		}
+	}
+
+	for (uint32_t i = first; i < m_Header->EntryCount && m_Entries[i].NameHash == hash; i++)
+	{
+		if (GetName(m_Entries[i]) == name)
+			return &m_Entries[i];
+	}
+
+	return nullptr;
+}
+
+std::span<const uint8_t> AssetArchive::Load(std::string_view name, std::vector<uint8_t>& storage) const
+{
+	const AssetArchiveEntry* entry = Find(name);
+
+	if (!entry)
+		throw std::runtime_error("Asset not found in archive: " + std::string(name));
+
+	return Load(*entry, storage);
+}
+
+std::span<const uint8_t> AssetArchive::Load(const AssetArchiveEntry& entry, [[maybe_unused]] std::vector<uint8_t>& storage) const
+{
+	const uint8_t* data = m_File.GetData() + entry.Offset;
+
+	switch (entry.Compression)
+	{
+	case AssetCompression::None:
+		return std::span<const uint8_t>(data, entry.Size);
+
+#ifdef ASSET_ARCHIVE_LZ4
+	case AssetCompression::LZ4:
+	{
+		storage.resize(entry.UncompressedSize);
+
+		int size = LZ4_decompress_safe(reinterpret_cast<const char*>(data), reinterpret_cast<char*>(storage.data()), static_cast<int>(entry.Size), static_cast<int>(entry.UncompressedSize));
+
+		if (size < 0 || static_cast<uint64_t>(size) != entry.UncompressedSize)
+			throw std::runtime_error("Failed to decompress asset: " + std::string(GetName(entry)));
+
+		return std::span<const uint8_t>(storage.data(), storage.size());
+	}
+#endif
+
+#ifdef ASSET_ARCHIVE_ZSTD
+	case AssetCompression::Zstd:
+	{
+		storage.resize(entry.UncompressedSize);
+
+		size_t size = ZSTD_decompress(storage.data(), storage.size(), data, entry.Size);
+
+		if (ZSTD_isError(size) || size != entry.UncompressedSize)
+			throw std::runtime_error("Failed to decompress asset: " + std::string(GetName(entry)));
+
+		return std::span<const uint8_t>(storage.data(), storage.size());
+	}
+#endif
+
+	default:
+		throw std::runtime_error("Unsupported compression for asset: " + std::string(GetName(entry)));
+	}
+}
@@ -0,0 +1,160 @@
+#include <algorithm>
+
+#include "DeletionQueue.h"
+
+template<typename T>
+static T FromHandle(uint64_t handle)
+{
+	if constexpr (std::is_pointer_v<T>)
+		return reinterpret_cast<T>(static_cast<uintptr_t>(handle));
+	else
+		return static_cast<T>(handle);
+}
+
+void DeletionQueue::Init(VkDevice device, const VkAllocationCallbacks* allocator)
+{
+	m_Device = device;
+	m_Allocator = allocator;
+}
+
+void DeletionQueue::SetRetireValue(uint64_t value)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_RetireValue = value;
+}
+
+void DeletionQueue::ReleaseBuffer(VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize size)
+{
+	// Buffer first, its memory can only be freed afterwards
+	Push(DeletionType::Buffer, buffer, 0);
+
+	if (memory != VK_NULL_HANDLE)
+		Push(DeletionType::Memory, memory, size);
+}
+
+void DeletionQueue::ReleaseImage(VkImage image, VkDeviceMemory memory, VkDeviceSize size)
+{
+	Push(DeletionType::Image, image, 0);
+
+	if (memory != VK_NULL_HANDLE)
+		Push(DeletionType::Memory, memory, size);
+}
+
+void DeletionQueue::ReleaseMemory(VkDeviceMemory memory, VkDeviceSize size)
+{
+	Push(DeletionType::Memory, memory, size);
+}
+
+void DeletionQueue::PushEntry(DeletionType type, uint64_t handle, VkDeviceSize size)
+{
+	if (handle == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	m_Entries.push_back({ m_RetireValue, handle, size, type });
+
+	m_Stats.ReleasedCount++;
+	m_Stats.PendingBytes += size;
+	m_Stats.QueueDepth = m_Entries.size();
+	m_Stats.PeakQueueDepth = std::max<uint64_t>(m_Stats.PeakQueueDepth, m_Stats.QueueDepth);
+}
+
+void DeletionQueue::Flush(uint64_t completed_value)
+{
+	// Collect the batch under the lock, destroy outside of it. The batch storage is taken out
+	// of the queue so concurrent flushes never share it.
+	std::vector<Entry> batch;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		batch.swap(m_Batch);
+
+		while (!m_Entries.empty() && m_Entries.front().RetireValue <= completed_value)
+		{
+			batch.push_back(m_Entries.front());
+			m_Entries.pop_front();
+		}
+
+		if (batch.empty())
+		{
+			batch.swap(m_Batch);
+			return;
+		}
+	}
+
+	VkDeviceSize reclaimed_bytes = 0;
+
+	for (const Entry& entry : batch)
+	{
+		Destroy(entry);
+		reclaimed_bytes += entry.Size;
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	m_Stats.DestroyedCount += batch.size();
+	m_Stats.ReclaimedBytes += reclaimed_bytes;
+	m_Stats.PendingBytes -= reclaimed_bytes;
+	m_Stats.QueueDepth = m_Entries.size();
+	m_Stats.BatchCount++;
+
+	// Hand the storage back for the next flush
+	batch.clear();
+
+	if (batch.capacity() > m_Batch.capacity())
+		batch.swap(m_Batch);
+}
+
+DeletionQueueStats DeletionQueue::GetStats() const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void DeletionQueue::Destroy(const Entry& entry)
+{
+	switch (entry.Type)
+	{
+	case DeletionType::Buffer:
+		vkDestroyBuffer(m_Device, FromHandle<VkBuffer>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::Image:
+		vkDestroyImage(m_Device, FromHandle<VkImage>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::ImageView:
+		vkDestroyImageView(m_Device, FromHandle<VkImageView>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::Sampler:
+		vkDestroySampler(m_Device, FromHandle<VkSampler>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::Memory:
+		vkFreeMemory(m_Device, FromHandle<VkDeviceMemory>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::Pipeline:
+		vkDestroyPipeline(m_Device, FromHandle<VkPipeline>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::PipelineLayout:
+		vkDestroyPipelineLayout(m_Device, FromHandle<VkPipelineLayout>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::DescriptorPool:
+		vkDestroyDescriptorPool(m_Device, FromHandle<VkDescriptorPool>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::DescriptorSetLayout:
+		vkDestroyDescriptorSetLayout(m_Device, FromHandle<VkDescriptorSetLayout>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::ShaderModule:
+		vkDestroyShaderModule(m_Device, FromHandle<VkShaderModule>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::Framebuffer:
+		vkDestroyFramebuffer(m_Device, FromHandle<VkFramebuffer>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::RenderPass:
+		vkDestroyRenderPass(m_Device, FromHandle<VkRenderPass>(entry.Handle), m_Allocator);
+		break;
+	case DeletionType::QueryPool:
+		vkDestroyQueryPool(m_Device, FromHandle<VkQueryPool>(entry.Handle), m_Allocator);
+		break;
+	}
+}
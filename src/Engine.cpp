@@ -3,10 +3,19 @@
 #include <array>
 #include <algorithm>
 #include <fstream>
+#include <cmath>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <cstddef>
+#include <random>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 
 #include "Engine.h"
+#include "TaskGraph.h"
+#include "MappedFile.h"
+#include "VulkanResult.h"
 
 
 #define VK_USE_PLATFORM_WIN32_KHR
@@ -17,19 +26,88 @@
 
 const int MAX_FRAMES_IN_FLIGHT = 2;
 
-static Engine* s_Instance = nullptr;
+// Demo scene, a grid of spinning triangles
+const uint32_t SCENE_GRID_SIZE = 128;
+
+const VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+// Workgroup sizes of hiz.comp and cull.comp
+const uint32_t HIZ_GROUP_SIZE = 8;
+const uint32_t CULL_GROUP_SIZE = 64;
+
+// Textures the sprite descriptor pool has room for
+const uint32_t MAX_SPRITE_TEXTURES = 256;
 
-static void check_vk_result(const VkResult result)
+// Samples kept by the HUD's frame time graph, and its scale
+const uint32_t FRAME_TIME_HISTORY = 120;
+const float FRAME_TIME_GRAPH_PIXELS_PER_MS = 6.0f;
+
+// SPIR-V read by the startup graph while the device is created
+const char* const STARTUP_SHADERS[] = { "shaders/vert.spv", "shaders/frag.spv", "shaders/cluster.spv", "shaders/hiz.spv", "shaders/cull.spv", "shaders/sprite_vert.spv", "shaders/sprite_frag.spv" };
+
+// Mirrors the DrawData block in cull.comp
+struct CullDrawData
 {
-	if (result == 0)
-	{
-		return;
-	}
+	VkDrawIndirectCommand EarlyDraw;
+	VkDrawIndirectCommand LateDraw;
+	uint32_t FrustumCulled;
+	uint32_t OccludedEarly;
+	uint32_t OccludedLate;
+	uint32_t Padding;
+};
+
+// Clustered lighting grid, screen tiles times depth slices
+const uint32_t CLUSTER_TILE_SIZE = 64;
+const uint32_t CLUSTER_DEPTH_SLICES = 24;
+const uint32_t CLUSTER_GROUP_SIZE = 64;
+
+// Has to match MAX_CLUSTER_LIGHTS in cluster.comp
+const uint32_t MAX_CLUSTER_LIGHTS = 128;
+
+// Frame start, after light assignment, after the early pass, after the late pass, after readback
+const uint32_t LIGHTING_TIMESTAMP_COUNT = 5;
+
+// Mirrors the ClusterData block in cluster.comp
+struct ClusterData
+{
+	uint32_t IndexCount;
+	uint32_t MaxClusterLights;
+	uint32_t OverflowCount;
+	uint32_t Padding;
+};
 
-	throw std::runtime_error("[Vulkan] Error: VkResult = " + result);
-}
+struct ClusterConstants
+{
+	float ViewProjection[16];
+	uint32_t ClusterCount[4];
+	float ClusterSize[2];
+	float Extent[2];
+};
+
+struct ClusterShadingConstants
+{
+	uint32_t ClusterCount[4];
+	float ClusterSize[2];
+};
+
+struct HiZConstants
+{
+	int32_t InputSize[2];
+	int32_t OutputSize[2];
+};
 
-static std::vector<char> ReadFile(const std::string& filename)
+struct CullConstants
+{
+	float ViewProjection[16];
+	float HiZSize[2];
+	uint32_t InstanceCount;
+	uint32_t Phase;
+	uint32_t HiZValid;
+};
+
+static Engine* s_Instance = nullptr;
+
+static std::vector<uint8_t> ReadFile(const std::string& filename)
 {
 	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
@@ -41,26 +119,73 @@ static std::vector<char> ReadFile(const std::string& filename)
 	auto file_size = file.tellg();
 	file.seekg(0);
 
-	std::vector<char> buffer(file_size);
+	std::vector<uint8_t> buffer(file_size);
 
-	file.seekg(0);
-	file.read(buffer.data(), file_size);
+	file.read(reinterpret_cast<char*>(buffer.data()), file_size);
 
 	file.close();
 
 	return buffer;
 }
 
+static uint32_t FindMemoryType(VkPhysicalDevice physical_device, uint32_t type_filter, VkMemoryPropertyFlags properties)
+{
+	VkPhysicalDeviceMemoryProperties memory_properties;
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++)
+	{
+		if ((type_filter & (1 << i)) && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+		{
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type.");
+}
+
+static void CmdMemoryBarrier(VkCommandBuffer buffer, VkPipelineStageFlags src_stage, VkAccessFlags src_access, VkPipelineStageFlags dst_stage, VkAccessFlags dst_access)
+{
+	VkMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = src_access;
+	barrier.dstAccessMask = dst_access;
+
+	vkCmdPipelineBarrier(buffer, src_stage, dst_stage, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
 void Engine::CreateVulkanInstance()
 {
+	TRACE_FUNCTION();
+
 	VkResult result;
 
+	// Optional, VK_EXT_memory_budget is queried through vkGetPhysicalDeviceMemoryProperties2KHR
+	std::vector<const char*> extensions = m_SDLExtensions;
+	{
+		uint32_t count = 0;
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, nullptr);
+
+		std::vector<VkExtensionProperties> instance_extensions(count);
+		vkEnumerateInstanceExtensionProperties(nullptr, &count, instance_extensions.data());
+
+		for (const auto& extension : instance_extensions)
+		{
+			if (strcmp(extension.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0)
+			{
+				extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+				m_HasPhysicalDeviceProperties2 = true;
+				break;
+			}
+		}
+	}
+
 	// Creating Vulkan Instance
 	VkInstanceCreateInfo create_info = {};
 	create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 	create_info.enabledLayerCount = 0;
-	create_info.enabledExtensionCount = m_SDLExtensionCount;
-	create_info.ppEnabledExtensionNames = m_SDLExtensions.data();
+	create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	create_info.ppEnabledExtensionNames = extensions.data();
 
 #ifdef _DEBUG
 
@@ -75,13 +200,17 @@ void Engine::CreateVulkanInstance()
 
 #endif
 
-	result = vkCreateInstance(&create_info, nullptr, &m_Instance);
+	result = vkCreateInstance(&create_info, m_Allocator, &m_Instance);
 	check_vk_result(result);
 }
 
 void Engine::SetupVulkan()
 {
+	TRACE_FUNCTION();
+
 	VkResult result;
+	bool has_memory_budget = false;
+	bool has_timeline_semaphore = false;
 
 	// Select GPU
 	{
@@ -159,6 +288,75 @@ void Engine::SetupVulkan()
 
 		if (!available)
 			throw std::runtime_error("Failed to find all required device extensions.");
+
+		// Optional, correlates GPU timestamps with the host clock for tracing
+		for (const auto& extension : device_extensions)
+		{
+			if (strcmp(extension.extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) != 0)
+				continue;
+
+#ifdef _WIN32
+			const VkTimeDomainEXT host_time_domain = VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT;
+#else
+			const VkTimeDomainEXT host_time_domain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+#endif
+
+			auto get_time_domains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(vkGetInstanceProcAddr(m_Instance, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+
+			if (!get_time_domains)
+				break;
+
+			uint32_t domain_count = 0;
+			get_time_domains(m_PhysicalDevice, &domain_count, nullptr);
+
+			std::vector<VkTimeDomainEXT> time_domains(domain_count);
+			get_time_domains(m_PhysicalDevice, &domain_count, time_domains.data());
+
+			bool has_device = std::find(time_domains.begin(), time_domains.end(), VK_TIME_DOMAIN_DEVICE_EXT) != time_domains.end();
+			bool has_host = std::find(time_domains.begin(), time_domains.end(), host_time_domain) != time_domains.end();
+
+			if (has_device && has_host)
+				m_HostTimeDomain = host_time_domain;
+
+			break;
+		}
+
+		// Optional, the driver's budget per heap instead of an estimate from the heap size
+		for (const auto& extension : device_extensions)
+		{
+			if (m_HasPhysicalDeviceProperties2 && strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+			{
+				has_memory_budget = true;
+				break;
+			}
+		}
+
+		// Optional, replaces the frame fences
+		for (const auto& extension : device_extensions)
+		{
+			if (!m_Specification.TimelineSemaphores || !m_HasPhysicalDeviceProperties2)
+				break;
+
+			if (strcmp(extension.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) != 0)
+				continue;
+
+			auto get_features2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(m_Instance, "vkGetPhysicalDeviceFeatures2KHR"));
+
+			if (!get_features2)
+				break;
+
+			VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {};
+			timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+			VkPhysicalDeviceFeatures2KHR features = {};
+			features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+			features.pNext = &timeline_features;
+
+			get_features2(m_PhysicalDevice, &features);
+			has_timeline_semaphore = timeline_features.timelineSemaphore == VK_TRUE;
+
+			break;
+		}
 	}
 
 	// Create Logical Device
@@ -171,17 +369,39 @@ void Engine::SetupVulkan()
 		queue_info.queueCount = 1;
 		queue_info.pQueuePriorities = &priority;
 
+		VkPhysicalDeviceFeatures supported_features;
+		vkGetPhysicalDeviceFeatures(m_PhysicalDevice, &supported_features);
+
+		// The late occlusion culling draw starts behind the instances of the early one
+		if (!supported_features.drawIndirectFirstInstance)
+			throw std::runtime_error("GPU doesn't support drawIndirectFirstInstance.");
+
 		VkPhysicalDeviceFeatures features = {};
+		features.drawIndirectFirstInstance = VK_TRUE;
+
+		std::vector<const char*> device_extensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+
+		if (m_HostTimeDomain != VK_TIME_DOMAIN_DEVICE_EXT)
+			device_extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+		if (has_memory_budget)
+			device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features = {};
+		timeline_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+		timeline_features.timelineSemaphore = VK_TRUE;
 
-		const char* device_extension[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+		if (has_timeline_semaphore)
+			device_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
 
 		VkDeviceCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		create_info.pQueueCreateInfos = &queue_info;
 		create_info.queueCreateInfoCount = 1;
 		create_info.pEnabledFeatures = &features;
-		create_info.enabledExtensionCount = 1;
-		create_info.ppEnabledExtensionNames = device_extension;
+		create_info.enabledExtensionCount = static_cast<uint32_t>(device_extensions.size());
+		create_info.ppEnabledExtensionNames = device_extensions.data();
+		create_info.pNext = has_timeline_semaphore ? &timeline_features : nullptr;
 
 #ifdef _DEBUG
 		const char* validation_layers[] = { "VK_LAYER_KHRONOS_validation" };
@@ -191,10 +411,28 @@ void Engine::SetupVulkan()
 		create_info.enabledLayerCount = 0;
 #endif
 
-		result = vkCreateDevice(m_PhysicalDevice, &create_info, nullptr, &m_Device);
+		result = vkCreateDevice(m_PhysicalDevice, &create_info, m_Allocator, &m_Device);
 		check_vk_result(result);
 
 		vkGetDeviceQueue(m_Device, m_QueueFamily, 0, &m_Queue);
+
+		if (m_HostTimeDomain != VK_TIME_DOMAIN_DEVICE_EXT)
+			m_GetCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(vkGetDeviceProcAddr(m_Device, "vkGetCalibratedTimestampsEXT"));
+
+		m_DeletionQueue.Init(m_Device, m_Allocator);
+
+		if (has_timeline_semaphore)
+			m_TimelineQueue.Init(m_Device, m_Allocator, m_Queue);
+
+		m_FrameSyncStats.Timeline = has_timeline_semaphore;
+
+		PFN_vkGetPhysicalDeviceMemoryProperties2KHR get_memory_properties2 = nullptr;
+
+		if (has_memory_budget)
+			get_memory_properties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(m_Instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+
+		m_MemoryBudget.Init(m_PhysicalDevice, get_memory_properties2);
+		m_Residency.SetBudgetFraction(m_Specification.MemoryBudgetFraction);
 	}
 
 	// Query Swap Chain support
@@ -291,7 +529,7 @@ void Engine::SetupVulkan()
 		m_SwapchainImageFormat = selected_format.format;
 		m_SwapchainExtent = extent;
 
-		result = vkCreateSwapchainKHR(m_Device, &create_info, nullptr, &m_Swapchain);
+		result = vkCreateSwapchainKHR(m_Device, &create_info, m_Allocator, &m_Swapchain);
 		check_vk_result(result);
 
 		uint32_t swapchain_image_count;
@@ -326,7 +564,7 @@ void Engine::SetupVulkan()
 			create_info.subresourceRange.baseArrayLayer = 0;
 			create_info.subresourceRange.layerCount = 1;
 
-			result = vkCreateImageView(m_Device, &create_info, nullptr, &m_SwapchainImageViews[i]);
+			result = vkCreateImageView(m_Device, &create_info, m_Allocator, &m_SwapchainImageViews[i]);
 			check_vk_result(result);
 		}
 	}
@@ -334,17 +572,29 @@ void Engine::SetupVulkan()
 
 void Engine::CreateVulkanRenderPass()
 {
-	VkResult result;
+	TRACE_FUNCTION();
 
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	VkResult result;
 
-	VkAttachmentDescription color_attachment = {};
+	// The depth of the previous pass is read by the Hi-Z build, which has to finish before it's written again
+	VkSubpassDependency dependencies[2] = {};
+	dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[0].dstSubpass = 0;
+	dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+	dependencies[1].srcSubpass = 0;
+	dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+	dependencies[1].srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+	dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+	VkAttachmentDescription attachments[2] = {};
+
+	VkAttachmentDescription& color_attachment = attachments[0];
 	color_attachment.format = m_SwapchainImageFormat;
 	color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -352,59 +602,75 @@ void Engine::CreateVulkanRenderPass()
 	color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	// Depth stays readable by the Hi-Z build between the passes
+	VkAttachmentDescription& depth_attachment = attachments[1];
+	depth_attachment.format = DEPTH_FORMAT;
+	depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	depth_attachment.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
 	VkAttachmentReference color_attachment_ref = {};
 	color_attachment_ref.attachment = 0;
 	color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+	VkAttachmentReference depth_attachment_ref = {};
+	depth_attachment_ref.attachment = 1;
+	depth_attachment_ref.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
 	VkSubpassDescription subpass = {};
 	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
 	subpass.colorAttachmentCount = 1;
 	subpass.pColorAttachments = &color_attachment_ref;
+	subpass.pDepthStencilAttachment = &depth_attachment_ref;
 
 	VkRenderPassCreateInfo create_info = {};
 	create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	create_info.attachmentCount = 1;
-	create_info.pAttachments = &color_attachment;
+	create_info.attachmentCount = 2;
+	create_info.pAttachments = attachments;
 	create_info.subpassCount = 1;
 	create_info.pSubpasses = &subpass;
-	create_info.dependencyCount = 1;
-	create_info.pDependencies = &dependency;
+	create_info.dependencyCount = 2;
+	create_info.pDependencies = dependencies;
+
+	// Early pass, draws what was visible in the previous frame
+	result = vkCreateRenderPass(m_Device, &create_info, m_Allocator, &m_Renderpass);
+	check_vk_result(result);
+
+	// Late pass, adds the instances disoccluded this frame and presents
+	color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	color_attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	depth_attachment.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	result = vkCreateRenderPass(m_Device, &create_info, nullptr, &m_Renderpass);
-	check_vk_result(result);	
+	result = vkCreateRenderPass(m_Device, &create_info, m_Allocator, &m_RenderpassLate);
+	check_vk_result(result);
 }
 
-void Engine::CreateVulkanGraphicsPipeline()
+void Engine::CreateVulkanDepthResources()
 {
-	VkResult result;
+	TRACE_FUNCTION();
 
-	// Read Shader Binaries
-	auto vert_shader_code = ReadFile("assets/shaders/vert.spv");
-	auto frag_shader_code = ReadFile("assets/shaders/frag.spv");
+	// Sampled by the Hi-Z build
+	CreateImage(m_SwapchainExtent.width, m_SwapchainExtent.height, 1, DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, m_DepthImage, m_DepthImageMemory);
+	m_DepthImageView = CreateImageView(m_DepthImage, DEPTH_FORMAT, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+}
 
-	// Vertex Shader Module Create Info
-	VkShaderModule vert_shader_module;
-	VkShaderModule frag_shader_module;
-	{
-		VkShaderModuleCreateInfo create_info = {};
-		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		create_info.codeSize = vert_shader_code.size();
-		create_info.pCode = reinterpret_cast<const uint32_t*> (vert_shader_code.data());
-		result = vkCreateShaderModule(m_Device, &create_info, nullptr, &vert_shader_module);
-		check_vk_result(result);
-	}
+void Engine::CreateVulkanGraphicsPipeline()
+{
+	TRACE_FUNCTION();
 
-	// Fragment Shader Module Create Info
-	{
-		VkShaderModuleCreateInfo create_info = {};
-		create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-		create_info.codeSize = frag_shader_code.size();
-		create_info.pCode = reinterpret_cast<const uint32_t*> (frag_shader_code.data());
-		result = vkCreateShaderModule(m_Device, &create_info, nullptr, &frag_shader_module);
-		check_vk_result(result);
-	}
+	VkResult result;
+
+	// Shader Modules (the SPIR-V was read while the device got created)
+	VkShaderModule vert_shader_module = CreateShaderModule("shaders/vert.spv");
+	VkShaderModule frag_shader_module = CreateShaderModule("shaders/frag.spv");
 
 	// Vertex Shader Stage Create Info
 	VkPipelineShaderStageCreateInfo shader_stages[2];
@@ -429,13 +695,29 @@ void Engine::CreateVulkanGraphicsPipeline()
 		shader_stages[1] = create_info;
 	}
 
-	// Vertex Input Create Info
+	// Vertex Input Create Info (per-instance world matrix, one attribute per column)
+	VkVertexInputBindingDescription instance_binding = {};
+	instance_binding.binding = 0;
+	instance_binding.stride = SCENE_INSTANCE_STRIDE;
+	instance_binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+	VkVertexInputAttributeDescription instance_attributes[4];
+
+	for (uint32_t i = 0; i < 4; i++)
+	{
+		instance_attributes[i] = {};
+		instance_attributes[i].binding = 0;
+		instance_attributes[i].location = i;
+		instance_attributes[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+		instance_attributes[i].offset = i * 4 * sizeof(float);
+	}
+
 	VkPipelineVertexInputStateCreateInfo vertex_input = {};
 	vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-	vertex_input.vertexBindingDescriptionCount = 0;
-	vertex_input.pVertexBindingDescriptions = nullptr;
-	vertex_input.vertexAttributeDescriptionCount = 0;
-	vertex_input.pVertexAttributeDescriptions = nullptr;
+	vertex_input.vertexBindingDescriptionCount = 1;
+	vertex_input.pVertexBindingDescriptions = &instance_binding;
+	vertex_input.vertexAttributeDescriptionCount = 4;
+	vertex_input.pVertexAttributeDescriptions = instance_attributes;
 
 	// Input Assembly Create Info
 	VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
@@ -480,6 +762,15 @@ void Engine::CreateVulkanGraphicsPipeline()
 	multisample.alphaToCoverageEnable = VK_FALSE;
 	multisample.alphaToOneEnable = VK_FALSE;
 
+	// Depth Stencil Create Info
+	VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+	depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depth_stencil.depthTestEnable = VK_TRUE;
+	depth_stencil.depthWriteEnable = VK_TRUE;
+	depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depth_stencil.depthBoundsTestEnable = VK_FALSE;
+	depth_stencil.stencilTestEnable = VK_FALSE;
+
 	// Color Blending Attachment State and Create Info
 	VkPipelineColorBlendAttachmentState color_blend_attachment = {};
 	color_blend_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -504,14 +795,20 @@ void Engine::CreateVulkanGraphicsPipeline()
 
 	// Create Pipeline Layout
 	{
+		// Cluster light lists for the fragment shader
+		VkPushConstantRange push_constants = {};
+		push_constants.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		push_constants.offset = 0;
+		push_constants.size = sizeof(ClusterShadingConstants);
+
 		VkPipelineLayoutCreateInfo pipeline_layout = {};
 		pipeline_layout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-		pipeline_layout.setLayoutCount = 0;
-		pipeline_layout.pSetLayouts = nullptr;
-		pipeline_layout.pPushConstantRanges = 0;
-		pipeline_layout.pPushConstantRanges = nullptr;
+		pipeline_layout.setLayoutCount = 1;
+		pipeline_layout.pSetLayouts = &m_LightingSetLayout;
+		pipeline_layout.pushConstantRangeCount = 1;
+		pipeline_layout.pPushConstantRanges = &push_constants;
 		
-		result = vkCreatePipelineLayout(m_Device, &pipeline_layout, nullptr, &m_PipelineLayout);
+		result = vkCreatePipelineLayout(m_Device, &pipeline_layout, m_Allocator, &m_PipelineLayout);
 		check_vk_result(result);
 	}
 	
@@ -526,7 +823,7 @@ void Engine::CreateVulkanGraphicsPipeline()
 		create_info.pViewportState = &viewport_state;
 		create_info.pRasterizationState = &rasterizer;
 		create_info.pMultisampleState = &multisample;
-		create_info.pDepthStencilState = nullptr;
+		create_info.pDepthStencilState = &depth_stencil;
 		create_info.pColorBlendState = &color_blend;
 		create_info.pDynamicState = &dynamic_state;
 		create_info.layout = m_PipelineLayout;
@@ -535,40 +832,45 @@ void Engine::CreateVulkanGraphicsPipeline()
 		create_info.basePipelineHandle = VK_NULL_HANDLE;
 		create_info.basePipelineIndex = -1;
 
-		result = vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &create_info, nullptr, &m_Pipeline);
+		result = vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, 1, &create_info, m_Allocator, &m_Pipeline);
 		check_vk_result(result);
 	}
 
-	vkDestroyShaderModule(m_Device, vert_shader_module, nullptr);
-	vkDestroyShaderModule(m_Device, frag_shader_module, nullptr);
+	vkDestroyShaderModule(m_Device, vert_shader_module, m_Allocator);
+	vkDestroyShaderModule(m_Device, frag_shader_module, m_Allocator);
 }
 
 void Engine::CreateVulkanFramebuffers()
 {
+	TRACE_FUNCTION();
+
 	VkResult result;
 
 	m_SwapchainFramebuffers.resize(m_SwapchainImageViews.size());
 
 	for (size_t i = 0; i < m_SwapchainImageViews.size(); i++)
 	{
-		VkImageView attachments[] = { m_SwapchainImageViews[i] };
+		VkImageView attachments[] = { m_SwapchainImageViews[i], m_DepthImageView };
 
+		// Also used with the compatible late render pass
 		VkFramebufferCreateInfo create_info = {};
 		create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
 		create_info.renderPass = m_Renderpass;
-		create_info.attachmentCount = 1;
+		create_info.attachmentCount = 2;
 		create_info.pAttachments = attachments;
 		create_info.width = m_SwapchainExtent.width;
 		create_info.height = m_SwapchainExtent.height;
 		create_info.layers = 1;
 
-		result = vkCreateFramebuffer(m_Device, &create_info, nullptr, &m_SwapchainFramebuffers[i]);
+		result = vkCreateFramebuffer(m_Device, &create_info, m_Allocator, &m_SwapchainFramebuffers[i]);
 		check_vk_result(result);
 	}
 }
 
 void Engine::CreateVulkanCommandPool()
 {
+	TRACE_FUNCTION();
+
 	VkResult result;
 
 	VkCommandPoolCreateInfo create_info = {};
@@ -576,13 +878,15 @@ void Engine::CreateVulkanCommandPool()
 	create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 	create_info.queueFamilyIndex = m_QueueFamily;
 
-	result = vkCreateCommandPool(m_Device, &create_info, nullptr, &m_CommandPool);
+	result = vkCreateCommandPool(m_Device, &create_info, m_Allocator, &m_CommandPool);
 	check_vk_result(result);
 
 }
 
 void Engine::CreateVulkanCommandBuffers()
 {
+	TRACE_FUNCTION();
+
 	VkResult result;
 	
 	m_CommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
@@ -593,12 +897,17 @@ void Engine::CreateVulkanCommandBuffers()
 	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
 	alloc_info.commandBufferCount = (uint32_t) m_CommandBuffers.size();
 
+	// The startup tasks record single time commands from the same pool
+	std::lock_guard<std::mutex> lock(m_SingleTimeCommandsMutex);
+
 	result = vkAllocateCommandBuffers(m_Device, &alloc_info, m_CommandBuffers.data());
 	check_vk_result(result);
 }
 
 void Engine::RecordCommandBuffer(VkCommandBuffer buffer, uint32_t image_index)
 {
+	TRACE_FUNCTION();
+
 	VkResult result;
 	
 	// Start Command Buffer
@@ -611,25 +920,109 @@ void Engine::RecordCommandBuffer(VkCommandBuffer buffer, uint32_t image_index)
 		result = vkBeginCommandBuffer(buffer, &info);
 		check_vk_result(result);
 	}
-	
+
+	CullingFrame& frame = m_CullingFrames[m_CurrentFrame];
+	LightingFrame& lighting = m_LightingFrames[m_CurrentFrame];
+
+	vkCmdResetQueryPool(buffer, lighting.TimestampPool, 0, LIGHTING_TIMESTAMP_COUNT);
+	vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, lighting.TimestampPool, 0);
+
+	RecordMeshCopies(buffer);
+
+	// Reset the indirect draws and counters
+	{
+		CullDrawData draw_data = {};
+		draw_data.EarlyDraw.vertexCount = 3;
+		draw_data.LateDraw.vertexCount = 3;
+
+		vkCmdUpdateBuffer(buffer, frame.DrawDataBuffer, 0, sizeof(draw_data), &draw_data);
+		vkCmdFillBuffer(buffer, lighting.ClusterDataBuffer, 0, sizeof(ClusterData), 0);
+
+		CmdMemoryBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+	}
+
+	RecordLightAssignment(buffer);
+
+	vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, lighting.TimestampPool, 1);
+
+	// Phase 0, test against the Hi-Z of the previous frame's depth and draw what passes
+	if (m_HiZValid)
+		RecordHiZBuild(buffer);
+
+	RecordOcclusionCulling(buffer, 0);
+
+	CmdMemoryBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+	RecordScenePass(buffer, image_index, m_Renderpass, offsetof(CullDrawData, EarlyDraw));
+
+	vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, lighting.TimestampPool, 2);
+
+	// Phase 1, re-test the occluded instances against the Hi-Z of this frame's depth
+	RecordHiZBuild(buffer);
+	RecordOcclusionCulling(buffer, 1);
+
+	CmdMemoryBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+		VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+
+	RecordScenePass(buffer, image_index, m_RenderpassLate, offsetof(CullDrawData, LateDraw));
+
+	vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, lighting.TimestampPool, 3);
+
+	// Read back the counters, they are picked up once the frame's fence signaled
+	{
+		VkBufferCopy copy = {};
+		copy.size = sizeof(CullDrawData);
+		vkCmdCopyBuffer(buffer, frame.DrawDataBuffer, frame.ReadbackBuffer, 1, &copy);
+
+		copy.size = sizeof(ClusterData);
+		vkCmdCopyBuffer(buffer, lighting.ClusterDataBuffer, lighting.ReadbackBuffer, 1, &copy);
+
+		CmdMemoryBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+	}
+
+	vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, lighting.TimestampPool, 4);
+
+	result = vkEndCommandBuffer(buffer);
+	check_vk_result(result);
+
+	m_HiZValid = true;
+}
+
+void Engine::RecordScenePass(VkCommandBuffer buffer, uint32_t image_index, VkRenderPass render_pass, VkDeviceSize draw_offset)
+{
 	// Start Render Pass
 	{
 		VkRenderPassBeginInfo info = {};
 		info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		info.renderPass = m_Renderpass;
+		info.renderPass = render_pass;
 		info.framebuffer = m_SwapchainFramebuffers[image_index];
 		info.renderArea.offset = { 0, 0 };
 		info.renderArea.extent = m_SwapchainExtent;
 		
-		VkClearValue clear_color = { {{0.0f, 0.0f, 0.0f, 1.0f}} };
-		info.clearValueCount = 1;
-		info.pClearValues = &clear_color;
+		VkClearValue clear_values[2] = {};
+		clear_values[0].color = { {0.0f, 0.0f, 0.0f, 1.0f} };
+		clear_values[1].depthStencil = { 1.0f, 0 };
+		info.clearValueCount = 2;
+		info.pClearValues = clear_values;
 
 		vkCmdBeginRenderPass(buffer, &info, VK_SUBPASS_CONTENTS_INLINE);
 	}
 
 	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipeline);
 
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_LightingFrames[m_CurrentFrame].DescriptorSet, 0, nullptr);
+
+	ClusterShadingConstants constants = {};
+	constants.ClusterCount[0] = m_ClusterCount[0];
+	constants.ClusterCount[1] = m_ClusterCount[1];
+	constants.ClusterCount[2] = m_ClusterCount[2];
+	constants.ClusterSize[0] = static_cast<float>(CLUSTER_TILE_SIZE);
+	constants.ClusterSize[1] = static_cast<float>(CLUSTER_TILE_SIZE);
+	vkCmdPushConstants(buffer, m_PipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(constants), &constants);
+
 	// Set Viewport and Scissor (dynamic)
 	VkViewport viewport = {};
 	viewport.x = 0.0f;
@@ -645,21 +1038,290 @@ void Engine::RecordCommandBuffer(VkCommandBuffer buffer, uint32_t image_index)
 	scissor.extent = m_SwapchainExtent;
 	vkCmdSetScissor(buffer, 0, 1, &scissor);
 
-	vkCmdDraw(buffer, 3, 1, 0, 0);
+	// Only the world matrices of the instances that passed culling
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(buffer, 0, 1, &m_CullingFrames[m_CurrentFrame].VisibleBuffer, &offset);
+
+	vkCmdDrawIndirect(buffer, m_CullingFrames[m_CurrentFrame].DrawDataBuffer, draw_offset, 1, sizeof(VkDrawIndirectCommand));
+
+	// The late pass is the last one writing the swapchain image, the overlay goes on top
+	if (render_pass == m_RenderpassLate)
+		RecordSprites(buffer);
 
 	vkCmdEndRenderPass(buffer);
+}
 
-	result = vkEndCommandBuffer(buffer);
+void Engine::RecordSprites(VkCommandBuffer buffer)
+{
+	const std::vector<SpriteBatch>& batches = m_SpriteBatcher.GetBatches();
+
+	if (batches.empty())
+		return;
+
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(buffer, 0, 1, &m_SpriteVertexBuffers[m_CurrentFrame], &offset);
+	vkCmdBindIndexBuffer(buffer, m_SpriteIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	float inverse_half_extent[2] = { 2.0f / m_SwapchainExtent.width, 2.0f / m_SwapchainExtent.height };
+	vkCmdPushConstants(buffer, m_SpritePipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(inverse_half_extent), inverse_half_extent);
+
+	// Batches are ordered by layer, then blend state, then texture, so each layer binds each pipeline at most once
+	uint32_t bound_blend = UINT32_MAX;
+	uint32_t bound_texture = UINT32_MAX;
+
+	for (const SpriteBatch& batch : batches)
+	{
+		uint32_t blend = static_cast<uint32_t>(batch.Blend);
+		uint32_t texture = batch.Texture < m_SpriteTextures.size() ? batch.Texture : 0;
+
+		if (blend != bound_blend)
+		{
+			vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SpritePipelines[blend]);
+			bound_blend = blend;
+		}
+
+		if (texture != bound_texture)
+		{
+			vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_SpritePipelineLayout, 0, 1, &m_SpriteTextures[texture].DescriptorSet, 0, nullptr);
+			bound_texture = texture;
+		}
+
+		vkCmdDrawIndexed(buffer, batch.QuadCount * SPRITE_INDICES_PER_QUAD, 1, batch.FirstQuad * SPRITE_INDICES_PER_QUAD, 0, 0);
+	}
+}
+
+void Engine::RecordLightAssignment(VkCommandBuffer buffer)
+{
+	uint32_t cluster_count = m_ClusterCount[0] * m_ClusterCount[1] * m_ClusterCount[2];
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ClusterPipeline);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_ClusterPipelineLayout, 0, 1, &m_LightingFrames[m_CurrentFrame].DescriptorSet, 0, nullptr);
+
+	ClusterConstants constants = {};
+	std::memcpy(constants.ViewProjection, m_ViewProjection, sizeof(m_ViewProjection));
+	constants.ClusterCount[0] = m_ClusterCount[0];
+	constants.ClusterCount[1] = m_ClusterCount[1];
+	constants.ClusterCount[2] = m_ClusterCount[2];
+	constants.ClusterCount[3] = m_LightingFrames[m_CurrentFrame].LightCount;
+	constants.ClusterSize[0] = static_cast<float>(CLUSTER_TILE_SIZE);
+	constants.ClusterSize[1] = static_cast<float>(CLUSTER_TILE_SIZE);
+	constants.Extent[0] = static_cast<float>(m_SwapchainExtent.width);
+	constants.Extent[1] = static_cast<float>(m_SwapchainExtent.height);
+	vkCmdPushConstants(buffer, m_ClusterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+	vkCmdDispatch(buffer, (cluster_count + CLUSTER_GROUP_SIZE - 1) / CLUSTER_GROUP_SIZE, 1, 1);
+
+	CmdMemoryBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT);
+}
+
+void Engine::RecordHiZBuild(VkCommandBuffer buffer)
+{
+	// The previous pyramid may still be sampled by culling
+	CmdMemoryBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_HiZPipeline);
+
+	VkExtent2D input_size = m_SwapchainExtent;
+	VkExtent2D output_size = m_HiZExtent;
+
+	for (uint32_t mip = 0; mip < m_HiZMipCount; mip++)
+	{
+		vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_HiZPipelineLayout, 0, 1, &m_HiZDescriptorSets[mip], 0, nullptr);
+
+		HiZConstants constants = {};
+		constants.InputSize[0] = static_cast<int32_t>(input_size.width);
+		constants.InputSize[1] = static_cast<int32_t>(input_size.height);
+		constants.OutputSize[0] = static_cast<int32_t>(output_size.width);
+		constants.OutputSize[1] = static_cast<int32_t>(output_size.height);
+		vkCmdPushConstants(buffer, m_HiZPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+		vkCmdDispatch(buffer, (output_size.width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (output_size.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+		// Next level reads this one
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = m_HiZImage;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = mip;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		input_size = output_size;
+		output_size.width = std::max(output_size.width / 2, 1u);
+		output_size.height = std::max(output_size.height / 2, 1u);
+	}
+}
+
+void Engine::RecordOcclusionCulling(VkCommandBuffer buffer, uint32_t phase)
+{
+	uint32_t instance_count = m_Scene.GetObjectCount();
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipeline);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_CullPipelineLayout, 0, 1, &m_CullingFrames[m_CurrentFrame].DescriptorSet, 0, nullptr);
+
+	CullConstants constants = {};
+	std::memcpy(constants.ViewProjection, m_ViewProjection, sizeof(m_ViewProjection));
+	constants.HiZSize[0] = static_cast<float>(m_HiZExtent.width);
+	constants.HiZSize[1] = static_cast<float>(m_HiZExtent.height);
+	constants.InstanceCount = instance_count;
+	constants.Phase = phase;
+	constants.HiZValid = phase == 1 || m_HiZValid;
+	vkCmdPushConstants(buffer, m_CullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+
+	// At least one group, phase 1 sets up the late draw in its first thread
+	vkCmdDispatch(buffer, std::max((instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1u), 1, 1);
+}
+
+void Engine::ReadCullingStats()
+{
+	const CullingFrame& frame = m_CullingFrames[m_CurrentFrame];
+
+	if (!frame.Submitted)
+		return;
+
+	const CullDrawData* draw_data = static_cast<const CullDrawData*>(frame.ReadbackMapped);
+
+	m_CullingStats.Instances = m_Scene.GetObjectCount();
+	m_CullingStats.FrustumCulled = draw_data->FrustumCulled;
+	m_CullingStats.VisibleEarly = draw_data->EarlyDraw.instanceCount;
+	m_CullingStats.Disoccluded = draw_data->LateDraw.instanceCount;
+	m_CullingStats.OccludedEarly = draw_data->OccludedEarly;
+	m_CullingStats.Occluded = draw_data->OccludedLate;
+}
+
+void Engine::ReadLightingStats()
+{
+	const LightingFrame& frame = m_LightingFrames[m_CurrentFrame];
+
+	if (!frame.Submitted)
+		return;
+
+	const ClusterData* cluster_data = static_cast<const ClusterData*>(frame.ReadbackMapped);
+
+	m_LightingStats.LightCount = frame.LightCount;
+	m_LightingStats.ClusterCount = m_ClusterCount[0] * m_ClusterCount[1] * m_ClusterCount[2];
+	m_LightingStats.LightIndexCount = cluster_data->IndexCount;
+	m_LightingStats.MaxClusterLights = cluster_data->MaxClusterLights;
+	m_LightingStats.OverflowCount = cluster_data->OverflowCount;
+
+	// The frame's fence signaled, so the timestamps are available
+	uint64_t timestamps[LIGHTING_TIMESTAMP_COUNT];
+	VkResult result = vkGetQueryPoolResults(m_Device, frame.TimestampPool, 0, LIGHTING_TIMESTAMP_COUNT, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+	if (result != VK_SUCCESS)
+		return;
+
+	m_LightingStats.AssignmentMs = (timestamps[1] - timestamps[0]) * m_TimestampPeriod * 1e-6;
+	m_LightingStats.FrameMs = (timestamps[4] - timestamps[0]) * m_TimestampPeriod * 1e-6;
+
+	m_LightingStats.FrameCount++;
+	m_LightingStats.AccumulatedAssignmentMs += m_LightingStats.AssignmentMs;
+	m_LightingStats.AccumulatedFrameMs += m_LightingStats.FrameMs;
+
+	if (m_Specification.LightBenchmarkFrames != 0)
+		RecordLightBenchmark();
+
+	if (Tracer::IsEnabled())
+	{
+		// The clocks drift apart, recalibrate every frame when it's cheap
+		if (m_GetCalibratedTimestamps)
+			CalibrateGpuClock();
+
+		const char* zone_names[] = { "Light Assignment", "Early Pass", "Late Pass", "Readback" };
+
+		Tracer& tracer = Tracer::Get();
+		tracer.AddGpuZone("GPU Frame", GpuTicksToHostTime(timestamps[0]), GpuTicksToHostTime(timestamps[4]));
+
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			tracer.AddGpuZone(zone_names[i], GpuTicksToHostTime(timestamps[i]), GpuTicksToHostTime(timestamps[i + 1]));
+		}
+	}
+}
+
+void Engine::CalibrateGpuClock()
+{
+	TRACE_FUNCTION();
+
+	VkResult result;
+
+	if (m_GetCalibratedTimestamps)
+	{
+		VkCalibratedTimestampInfoEXT infos[2] = {};
+		infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+		infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+		infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+		infos[1].timeDomain = m_HostTimeDomain;
+
+		uint64_t timestamps[2];
+		uint64_t max_deviation;
+
+		result = m_GetCalibratedTimestamps(m_Device, 2, infos, timestamps, &max_deviation);
+		check_vk_result(result);
+
+		m_CalibrationGpuTicks = timestamps[0];
+		m_CalibrationHostTime = Tracer::HostTicksToNanoseconds(timestamps[1]);
+		return;
+	}
+
+	// Fallback, timestamp an empty submit and take the middle of the host time around it.
+	// Off by up to half the submit latency.
+	VkQueryPoolCreateInfo query_info = {};
+	query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	query_info.queryCount = 1;
+
+	VkQueryPool query_pool;
+	result = vkCreateQueryPool(m_Device, &query_info, m_Allocator, &query_pool);
+	check_vk_result(result);
+
+	SingleTimeCommands commands = BeginSingleTimeCommands();
+	VkCommandBuffer buffer = commands.Buffer;
+	vkCmdResetQueryPool(buffer, query_pool, 0, 1);
+	vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+
+	uint64_t submit_time = Tracer::Now();
+	EndSingleTimeCommands(commands);
+	uint64_t idle_time = Tracer::Now();
+
+	uint64_t timestamp = 0;
+	result = vkGetQueryPoolResults(m_Device, query_pool, 0, 1, sizeof(timestamp), &timestamp, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
 	check_vk_result(result);
+
+	vkDestroyQueryPool(m_Device, query_pool, m_Allocator);
+
+	m_CalibrationGpuTicks = timestamp;
+	m_CalibrationHostTime = submit_time + (idle_time - submit_time) / 2;
+}
+
+uint64_t Engine::GpuTicksToHostTime(uint64_t ticks) const
+{
+	int64_t delta = static_cast<int64_t>(ticks - m_CalibrationGpuTicks);
+
+	return m_CalibrationHostTime + static_cast<int64_t>(delta * static_cast<double>(m_TimestampPeriod));
 }
 
 void Engine::CreateVulkanSyncObjects()
 {
+	TRACE_FUNCTION();
+
 	VkResult result;
 
 	m_SemaphoresImageAvailable.resize(MAX_FRAMES_IN_FLIGHT);
 	m_SemaphoresRenderFinished.resize(MAX_FRAMES_IN_FLIGHT);
 	m_FencesInFlight.resize(MAX_FRAMES_IN_FLIGHT);
+	m_FenceFrames.resize(MAX_FRAMES_IN_FLIGHT, 0);
+	m_FramePoints.resize(MAX_FRAMES_IN_FLIGHT, 0);
 
 	// Create Semaphores (Synchronization on the GPU)
 	{
@@ -668,10 +1330,10 @@ void Engine::CreateVulkanSyncObjects()
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 		{
-			result = vkCreateSemaphore(m_Device, &create_info, nullptr, &m_SemaphoresImageAvailable[i]);
+			result = vkCreateSemaphore(m_Device, &create_info, m_Allocator, &m_SemaphoresImageAvailable[i]);
 			check_vk_result(result);
 
-			result = vkCreateSemaphore(m_Device, &create_info, nullptr, &m_SemaphoresRenderFinished[i]);
+			result = vkCreateSemaphore(m_Device, &create_info, m_Allocator, &m_SemaphoresRenderFinished[i]);
 			check_vk_result(result);
 		}
 	}
@@ -684,25 +1346,1576 @@ void Engine::CreateVulkanSyncObjects()
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 		{
-			result = vkCreateFence(m_Device, &create_info, nullptr, &m_FencesInFlight[i]);
+			result = vkCreateFence(m_Device, &create_info, m_Allocator, &m_FencesInFlight[i]);
 			check_vk_result(result);
 		}
 	}
 }
 
-void Engine::RenderFrame()
+void Engine::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory)
 {
 	VkResult result;
 
-	vkWaitForFences(m_Device, 1, &m_FencesInFlight[m_CurrentFrame], VK_TRUE, UINT64_MAX);
-	vkResetFences(m_Device, 1, &m_FencesInFlight[m_CurrentFrame]);
+	VkBufferCreateInfo create_info = {};
+	create_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	create_info.size = size;
+	create_info.usage = usage;
+	create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
-	uint32_t image_index;
-	result = vkAcquireNextImageKHR(m_Device, m_Swapchain, UINT64_MAX, m_SemaphoresImageAvailable[m_CurrentFrame], VK_NULL_HANDLE, &image_index);
+	result = vkCreateBuffer(m_Device, &create_info, m_Allocator, &buffer);
 	check_vk_result(result);
 
-	vkResetCommandBuffer(m_CommandBuffers[m_CurrentFrame], 0);
-	RecordCommandBuffer(m_CommandBuffers[m_CurrentFrame], image_index);
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(m_Device, buffer, &requirements);
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = requirements.size;
+	alloc_info.memoryTypeIndex = FindMemoryType(m_PhysicalDevice, requirements.memoryTypeBits, properties);
+
+	result = vkAllocateMemory(m_Device, &alloc_info, m_Allocator, &memory);
+	check_vk_result(result);
+
+	m_MemoryBudget.TrackAllocation(memory, alloc_info.memoryTypeIndex, alloc_info.allocationSize);
+
+	result = vkBindBufferMemory(m_Device, buffer, memory, 0);
+	check_vk_result(result);
+}
+
+SingleTimeCommands::SingleTimeCommands(std::mutex& mutex, VkDevice device, VkCommandPool pool)
+	: Lock(mutex), Device(device), Pool(pool)
+{
+	VkResult result;
+
+	VkCommandBufferAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	alloc_info.commandPool = Pool;
+	alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	alloc_info.commandBufferCount = 1;
+
+	result = vkAllocateCommandBuffers(Device, &alloc_info, &Buffer);
+	check_vk_result(result);
+
+	VkCommandBufferBeginInfo info = {};
+	info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	result = vkBeginCommandBuffer(Buffer, &info);
+
+	// The destructor doesn't run when the constructor throws
+	if (result != VK_SUCCESS)
+		vkFreeCommandBuffers(Device, Pool, 1, &Buffer);
+
+	check_vk_result(result);
+}
+
+SingleTimeCommands::~SingleTimeCommands()
+{
+	if (Buffer != VK_NULL_HANDLE)
+		vkFreeCommandBuffers(Device, Pool, 1, &Buffer);
+}
+
+SingleTimeCommands Engine::BeginSingleTimeCommands()
+{
+	// Startup tasks share the command pool and the queue
+	return SingleTimeCommands(m_SingleTimeCommandsMutex, m_Device, m_CommandPool);
+}
+
+void Engine::EndSingleTimeCommands(SingleTimeCommands& commands)
+{
+	VkResult result;
+
+	VkCommandBuffer buffer = commands.Buffer;
+
+	result = vkEndCommandBuffer(buffer);
+	check_vk_result(result);
+
+	// Only waits for this submission, not the frames in flight
+	if (m_TimelineQueue.IsInitialized())
+	{
+		TimelineSubmitInfo timeline_submit;
+		timeline_submit.CommandBuffers = std::span<const VkCommandBuffer>(&buffer, 1);
+
+		m_TimelineQueue.Wait(m_TimelineQueue.Submit(timeline_submit));
+	}
+	else
+	{
+		VkSubmitInfo submit_info = {};
+		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submit_info.commandBufferCount = 1;
+		submit_info.pCommandBuffers = &buffer;
+
+		result = vkQueueSubmit(m_Queue, 1, &submit_info, VK_NULL_HANDLE);
+		check_vk_result(result);
+
+		result = vkQueueWaitIdle(m_Queue);
+		check_vk_result(result);
+	}
+
+	vkFreeCommandBuffers(m_Device, m_CommandPool, 1, &buffer);
+
+	commands.Buffer = VK_NULL_HANDLE;
+	commands.Lock.unlock();
+}
+
+void Engine::CreateImage(uint32_t width, uint32_t height, uint32_t mip_levels, VkFormat format, VkImageUsageFlags usage, VkImage& image, VkDeviceMemory& memory)
+{
+	VkResult result;
+
+	VkImageCreateInfo create_info = {};
+	create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	create_info.imageType = VK_IMAGE_TYPE_2D;
+	create_info.format = format;
+	create_info.extent = { width, height, 1 };
+	create_info.mipLevels = mip_levels;
+	create_info.arrayLayers = 1;
+	create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+	create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+	create_info.usage = usage;
+	create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+	create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+	result = vkCreateImage(m_Device, &create_info, m_Allocator, &image);
+	check_vk_result(result);
+
+	VkMemoryRequirements requirements;
+	vkGetImageMemoryRequirements(m_Device, image, &requirements);
+
+	VkMemoryAllocateInfo alloc_info = {};
+	alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	alloc_info.allocationSize = requirements.size;
+	alloc_info.memoryTypeIndex = FindMemoryType(m_PhysicalDevice, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	result = vkAllocateMemory(m_Device, &alloc_info, m_Allocator, &memory);
+	check_vk_result(result);
+
+	m_MemoryBudget.TrackAllocation(memory, alloc_info.memoryTypeIndex, alloc_info.allocationSize);
+
+	result = vkBindImageMemory(m_Device, image, memory, 0);
+	check_vk_result(result);
+}
+
+VkImageView Engine::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t base_mip, uint32_t mip_count)
+{
+	VkResult result;
+
+	VkImageViewCreateInfo create_info = {};
+	create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	create_info.image = image;
+	create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+	create_info.format = format;
+	create_info.subresourceRange.aspectMask = aspect;
+	create_info.subresourceRange.baseMipLevel = base_mip;
+	create_info.subresourceRange.levelCount = mip_count;
+	create_info.subresourceRange.baseArrayLayer = 0;
+	create_info.subresourceRange.layerCount = 1;
+
+	VkImageView image_view;
+	result = vkCreateImageView(m_Device, &create_info, m_Allocator, &image_view);
+	check_vk_result(result);
+
+	return image_view;
+}
+
+VkShaderModule Engine::CreateShaderModule(const std::string& name)
+{
+	VkResult result;
+
+	// Preloaded during startup, read on demand afterwards
+	std::vector<uint8_t> storage;
+	std::span<const uint8_t> code;
+
+	auto preloaded = m_ShaderCode.find(name);
+
+	if (preloaded != m_ShaderCode.end())
+		code = preloaded->second.Code;
+	else
+		code = LoadAsset(name, storage);
+
+	VkShaderModuleCreateInfo create_info = {};
+	create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	create_info.codeSize = code.size();
+	create_info.pCode = reinterpret_cast<const uint32_t*> (code.data());
+
+	VkShaderModule shader_module;
+	result = vkCreateShaderModule(m_Device, &create_info, m_Allocator, &shader_module);
+	check_vk_result(result);
+
+	return shader_module;
+}
+
+void Engine::OpenAssetArchive()
+{
+	TRACE_FUNCTION();
+
+	if (!std::filesystem::exists(m_Specification.AssetArchivePath))
+		return;
+
+	m_AssetArchive.Open(m_Specification.AssetArchivePath);
+}
+
+std::span<const uint8_t> Engine::LoadAsset(const std::string& name, std::vector<uint8_t>& storage)
+{
+	if (m_AssetArchive.Contains(name))
+		return m_AssetArchive.Load(name, storage);
+
+	storage = ReadFile("assets/" + name);
+
+	return std::span<const uint8_t>(storage.data(), storage.size());
+}
+
+uint32_t Engine::LoadMesh(const std::string& name)
+{
+	uint32_t mesh = static_cast<uint32_t>(m_Meshes.size());
+
+	m_Meshes.emplace_back();
+	m_Meshes[mesh].Name = name;
+
+	UploadMesh(mesh, false);
+
+	GpuMesh& gpu_mesh = m_Meshes[mesh];
+	uint32_t heap = m_MemoryBudget.GetAllocationHeap(gpu_mesh.VertexMemory);
+
+	gpu_mesh.ResidencyId = m_Residency.Register(heap, gpu_mesh.VertexBufferSize + gpu_mesh.IndexBufferSize, m_FrameCounter, [this, mesh]() { EvictMesh(mesh); });
+
+	return mesh;
+}
+
+void Engine::UploadMesh(uint32_t mesh_index, bool deferred)
+{
+	VkResult result;
+
+	const std::string& name = m_Meshes[mesh_index].Name;
+
+	// Packed meshes are read from the archive mapping, loose ones get mapped on their own
+	MappedFile file;
+	std::vector<uint8_t> storage;
+	std::span<const uint8_t> data;
+
+	if (m_AssetArchive.Contains(name))
+	{
+		data = m_AssetArchive.Load(name, storage);
+	}
+	else
+	{
+		file.Open("assets/" + name);
+		data = std::span<const uint8_t>(file.GetData(), file.GetSize());
+	}
+
+	MeshFileView view;
+
+	if (!ParseMeshFile(data.data(), data.size(), view))
+		throw std::runtime_error("Invalid or outdated mesh file: " + name);
+
+	const MeshFileHeader& header = *view.Header;
+
+	GpuMesh& mesh = m_Meshes[mesh_index];
+	mesh.VertexBufferSize = header.VertexSize;
+	mesh.IndexBufferSize = header.IndexSize;
+	mesh.VertexCount = header.VertexCount;
+	mesh.Lods.assign(view.Lods, view.Lods + header.LodCount);
+
+	for (int i = 0; i < 3; i++)
+	{
+		mesh.BoundsMin[i] = header.BoundsMin[i];
+		mesh.BoundsMax[i] = header.BoundsMax[i];
+	}
+
+	// One staging buffer for both, filled straight from the mapping
+	VkBuffer staging_buffer;
+	VkDeviceMemory staging_memory;
+	VkDeviceSize staging_size = header.VertexSize + header.IndexSize;
+
+	CreateBuffer(staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_memory);
+
+	void* staging_data;
+	result = vkMapMemory(m_Device, staging_memory, 0, staging_size, 0, &staging_data);
+	check_vk_result(result);
+
+	std::memcpy(staging_data, view.VertexData, header.VertexSize);
+	std::memcpy(static_cast<uint8_t*>(staging_data) + header.VertexSize, view.IndexData, header.IndexSize);
+
+	vkUnmapMemory(m_Device, staging_memory);
+
+	CreateBuffer(header.VertexSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh.VertexBuffer, mesh.VertexMemory);
+	CreateBuffer(header.IndexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mesh.IndexBuffer, mesh.IndexMemory);
+
+	// Restores are copied by the next frame, the staging buffer goes with it
+	if (deferred)
+	{
+		mesh.RestoreValue = UINT64_MAX;
+		m_MeshCopies.push_back({ mesh_index, staging_buffer, staging_memory, staging_size });
+		return;
+	}
+
+	SingleTimeCommands commands = BeginSingleTimeCommands();
+	VkCommandBuffer buffer = commands.Buffer;
+
+	VkBufferCopy vertex_copy = {};
+	vertex_copy.srcOffset = 0;
+	vertex_copy.size = header.VertexSize;
+	vkCmdCopyBuffer(buffer, staging_buffer, mesh.VertexBuffer, 1, &vertex_copy);
+
+	VkBufferCopy index_copy = {};
+	index_copy.srcOffset = header.VertexSize;
+	index_copy.size = header.IndexSize;
+	vkCmdCopyBuffer(buffer, staging_buffer, mesh.IndexBuffer, 1, &index_copy);
+
+	EndSingleTimeCommands(commands);
+
+	vkDestroyBuffer(m_Device, staging_buffer, m_Allocator);
+	m_MemoryBudget.TrackFree(staging_memory);
+	vkFreeMemory(m_Device, staging_memory, m_Allocator);
+}
+
+void Engine::UnloadMesh(uint32_t mesh)
+{
+	GpuMesh& gpu_mesh = m_Meshes[mesh];
+
+	if (gpu_mesh.ResidencyId != INVALID_RESIDENCY_ID)
+		m_Residency.Unregister(gpu_mesh.ResidencyId);
+
+	EvictMesh(mesh);
+
+	gpu_mesh = GpuMesh();
+}
+
+const GpuMesh* Engine::RequestMesh(uint32_t mesh)
+{
+	GpuMesh& gpu_mesh = m_Meshes[mesh];
+
+	// Unloaded meshes have no name left to upload from
+	if (gpu_mesh.ResidencyId == INVALID_RESIDENCY_ID)
+		throw std::runtime_error("Requested mesh " + std::to_string(mesh) + " after it was unloaded.");
+
+	if (m_Residency.IsResident(gpu_mesh.ResidencyId))
+	{
+		m_Residency.Touch(gpu_mesh.ResidencyId, m_FrameCounter);
+		return &gpu_mesh;
+	}
+
+	if (gpu_mesh.VertexBuffer == VK_NULL_HANDLE)
+	{
+		TRACE_SCOPE("Restore Mesh");
+
+		UploadMesh(mesh, true);
+		return nullptr;
+	}
+
+	// Frames finish in order, the copy is done once its frame is
+	uint64_t completed = m_TimelineQueue.IsInitialized() ? m_TimelineQueue.GetCompleted() : m_CompletedFrame;
+
+	if (gpu_mesh.RestoreValue > completed)
+		return nullptr;
+
+	m_Residency.MarkResident(gpu_mesh.ResidencyId, m_FrameCounter);
+
+	return &gpu_mesh;
+}
+
+void Engine::RecordMeshCopies(VkCommandBuffer buffer)
+{
+	if (m_MeshCopies.empty())
+		return;
+
+	for (const MeshCopy& copy : m_MeshCopies)
+	{
+		GpuMesh& mesh = m_Meshes[copy.Mesh];
+
+		VkBufferCopy vertex_copy = {};
+		vertex_copy.srcOffset = 0;
+		vertex_copy.size = mesh.VertexBufferSize;
+		vkCmdCopyBuffer(buffer, copy.StagingBuffer, mesh.VertexBuffer, 1, &vertex_copy);
+
+		VkBufferCopy index_copy = {};
+		index_copy.srcOffset = mesh.VertexBufferSize;
+		index_copy.size = mesh.IndexBufferSize;
+		vkCmdCopyBuffer(buffer, copy.StagingBuffer, mesh.IndexBuffer, 1, &index_copy);
+
+		// Released with this frame's retire value, gone once the copy is
+		m_MemoryBudget.TrackFree(copy.StagingMemory);
+		m_DeletionQueue.ReleaseBuffer(copy.StagingBuffer, copy.StagingMemory, copy.StagingSize);
+
+		mesh.RestoreValue = m_DeletionQueue.GetRetireValue();
+	}
+
+	m_MeshCopies.clear();
+
+	CmdMemoryBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT);
+}
+
+void Engine::EvictMesh(uint32_t mesh)
+{
+	GpuMesh& gpu_mesh = m_Meshes[mesh];
+
+	if (gpu_mesh.VertexBuffer == VK_NULL_HANDLE)
+		return;
+
+	// A restore that wasn't recorded yet never reaches the GPU
+	for (size_t i = 0; i < m_MeshCopies.size(); i++)
+	{
+		if (m_MeshCopies[i].Mesh != mesh)
+			continue;
+
+		m_MemoryBudget.TrackFree(m_MeshCopies[i].StagingMemory);
+		m_DeletionQueue.ReleaseBuffer(m_MeshCopies[i].StagingBuffer, m_MeshCopies[i].StagingMemory, m_MeshCopies[i].StagingSize);
+		m_MeshCopies.erase(m_MeshCopies.begin() + i);
+		break;
+	}
+
+	// Counted as freed right away, the memory itself goes once the frames in flight are done
+	m_MemoryBudget.TrackFree(gpu_mesh.VertexMemory);
+	m_MemoryBudget.TrackFree(gpu_mesh.IndexMemory);
+
+	m_DeletionQueue.ReleaseBuffer(gpu_mesh.VertexBuffer, gpu_mesh.VertexMemory, gpu_mesh.VertexBufferSize);
+	m_DeletionQueue.ReleaseBuffer(gpu_mesh.IndexBuffer, gpu_mesh.IndexMemory, gpu_mesh.IndexBufferSize);
+
+	// Name, bounds and LODs stay for the next upload
+	gpu_mesh.VertexBuffer = VK_NULL_HANDLE;
+	gpu_mesh.VertexMemory = VK_NULL_HANDLE;
+	gpu_mesh.IndexBuffer = VK_NULL_HANDLE;
+	gpu_mesh.IndexMemory = VK_NULL_HANDLE;
+}
+
+void Engine::LoadResidencyStress()
+{
+	TRACE_FUNCTION();
+
+	if (m_Specification.ResidencyStressMesh.empty() || m_Specification.ResidencyStressCopies == 0)
+		return;
+
+	VkDeviceSize mesh_bytes = 0;
+
+	for (uint32_t i = 0; i < m_Specification.ResidencyStressCopies; i++)
+	{
+		uint32_t mesh = LoadMesh(m_Specification.ResidencyStressMesh);
+		m_StressMeshes.push_back(mesh);
+		mesh_bytes += m_Meshes[mesh].VertexBufferSize + m_Meshes[mesh].IndexBufferSize;
+	}
+
+	// Everything else in the heap stays, only half of the copies fit next to it
+	m_MemoryBudget.Update();
+
+	uint32_t heap = m_MemoryBudget.GetAllocationHeap(m_Meshes[m_StressMeshes[0]].VertexMemory);
+	VkDeviceSize usage = m_MemoryBudget.GetHeap(heap).Usage;
+	VkDeviceSize limit = usage - std::min(usage, mesh_bytes / 2);
+
+	m_Residency.SetHeapLimit(heap, std::max<VkDeviceSize>(limit, 1));
+
+	std::cout << "[Memory] Residency stress: " << m_StressMeshes.size() << " copies of " << m_Specification.ResidencyStressMesh << " ("
+		<< mesh_bytes << " bytes), heap " << heap << " limited to " << limit / (1024 * 1024) << " MB" << std::endl;
+}
+
+void Engine::RequestResidencyStress()
+{
+	if (m_StressMeshes.empty())
+		return;
+
+	// The window moves by one copy a frame, the copy entering it was evicted a while ago
+	uint32_t count = static_cast<uint32_t>(m_StressMeshes.size());
+	uint32_t window = std::max(count / 4, 1u);
+
+	for (uint32_t i = 0; i < window; i++)
+	{
+		RequestMesh(m_StressMeshes[(m_FrameCounter + i) % count]);
+	}
+}
+
+void Engine::CreateVulkanInstanceBuffers()
+{
+	TRACE_FUNCTION();
+
+	VkResult result;
+
+	m_InstanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	m_InstanceBufferMemory.resize(MAX_FRAMES_IN_FLIGHT);
+	m_InstanceBufferMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+	VkDeviceSize size = static_cast<VkDeviceSize>(m_Specification.MaxInstances) * SCENE_INSTANCE_STRIDE;
+
+	// One buffer per frame in flight, the CPU writes the next frame while the GPU reads the current one
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		CreateBuffer(size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_InstanceBuffers[i], m_InstanceBufferMemory[i]);
+
+		// Persistently mapped, the transform update writes straight into it
+		result = vkMapMemory(m_Device, m_InstanceBufferMemory[i], 0, size, 0, &m_InstanceBufferMapped[i]);
+		check_vk_result(result);
+	}
+}
+
+void Engine::CreateVulkanLightingResources()
+{
+	TRACE_FUNCTION();
+
+	VkResult result;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(m_PhysicalDevice, &properties);
+	m_TimestampPeriod = properties.limits.timestampPeriod;
+
+	m_ClusterCount[0] = (m_SwapchainExtent.width + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+	m_ClusterCount[1] = (m_SwapchainExtent.height + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+	m_ClusterCount[2] = CLUSTER_DEPTH_SLICES;
+
+	VkDeviceSize cluster_count = m_ClusterCount[0] * m_ClusterCount[1] * m_ClusterCount[2];
+
+	// Descriptor Set Layout (lights, clusters, light indices and the counters)
+	{
+		VkDescriptorSetLayoutBinding bindings[4] = {};
+
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = i < 3 ? VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT : VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		create_info.bindingCount = 4;
+		create_info.pBindings = bindings;
+
+		result = vkCreateDescriptorSetLayout(m_Device, &create_info, m_Allocator, &m_LightingSetLayout);
+		check_vk_result(result);
+	}
+
+	// Descriptor Pool
+	{
+		VkDescriptorPoolSize pool_size = {};
+		pool_size.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		pool_size.descriptorCount = 4 * MAX_FRAMES_IN_FLIGHT;
+
+		VkDescriptorPoolCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		create_info.maxSets = MAX_FRAMES_IN_FLIGHT;
+		create_info.poolSizeCount = 1;
+		create_info.pPoolSizes = &pool_size;
+
+		result = vkCreateDescriptorPool(m_Device, &create_info, m_Allocator, &m_LightingDescriptorPool);
+		check_vk_result(result);
+	}
+
+	// Light Assignment Pipeline
+	{
+		VkPushConstantRange push_constants = {};
+		push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		push_constants.size = sizeof(ClusterConstants);
+
+		VkPipelineLayoutCreateInfo pipeline_layout = {};
+		pipeline_layout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout.setLayoutCount = 1;
+		pipeline_layout.pSetLayouts = &m_LightingSetLayout;
+		pipeline_layout.pushConstantRangeCount = 1;
+		pipeline_layout.pPushConstantRanges = &push_constants;
+
+		result = vkCreatePipelineLayout(m_Device, &pipeline_layout, m_Allocator, &m_ClusterPipelineLayout);
+		check_vk_result(result);
+
+		VkShaderModule shader_module = CreateShaderModule("shaders/cluster.spv");
+
+		VkComputePipelineCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+		create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		create_info.stage.module = shader_module;
+		create_info.stage.pName = "main";
+		create_info.layout = m_ClusterPipelineLayout;
+		create_info.basePipelineHandle = VK_NULL_HANDLE;
+		create_info.basePipelineIndex = -1;
+
+		result = vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 1, &create_info, m_Allocator, &m_ClusterPipeline);
+		check_vk_result(result);
+
+		vkDestroyShaderModule(m_Device, shader_module, m_Allocator);
+	}
+
+	// Per Frame Buffers, Timestamps and Descriptor Sets
+	m_LightingFrames.resize(MAX_FRAMES_IN_FLIGHT);
+
+	VkDeviceSize light_size = static_cast<VkDeviceSize>(m_Specification.MaxLights) * sizeof(PointLight);
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		LightingFrame& frame = m_LightingFrames[i];
+
+		CreateBuffer(light_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.LightBuffer, frame.LightMemory);
+
+		result = vkMapMemory(m_Device, frame.LightMemory, 0, light_size, 0, &frame.LightMapped);
+		check_vk_result(result);
+
+		// Full clusters drop lights, so the index list never runs out of space
+		CreateBuffer(cluster_count * 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.ClusterBuffer, frame.ClusterMemory);
+		CreateBuffer(cluster_count * MAX_CLUSTER_LIGHTS * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.LightIndexBuffer, frame.LightIndexMemory);
+		CreateBuffer(sizeof(ClusterData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.ClusterDataBuffer, frame.ClusterDataMemory);
+		CreateBuffer(sizeof(ClusterData), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.ReadbackBuffer, frame.ReadbackMemory);
+
+		result = vkMapMemory(m_Device, frame.ReadbackMemory, 0, sizeof(ClusterData), 0, &frame.ReadbackMapped);
+		check_vk_result(result);
+
+		VkQueryPoolCreateInfo query_info = {};
+		query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		query_info.queryCount = LIGHTING_TIMESTAMP_COUNT;
+
+		result = vkCreateQueryPool(m_Device, &query_info, m_Allocator, &frame.TimestampPool);
+		check_vk_result(result);
+
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = m_LightingDescriptorPool;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &m_LightingSetLayout;
+
+		result = vkAllocateDescriptorSets(m_Device, &alloc_info, &frame.DescriptorSet);
+		check_vk_result(result);
+
+		VkDescriptorBufferInfo buffer_infos[4] = {};
+		buffer_infos[0].buffer = frame.LightBuffer;
+		buffer_infos[1].buffer = frame.ClusterBuffer;
+		buffer_infos[2].buffer = frame.LightIndexBuffer;
+		buffer_infos[3].buffer = frame.ClusterDataBuffer;
+
+		VkWriteDescriptorSet writes[4] = {};
+
+		for (uint32_t binding = 0; binding < 4; binding++)
+		{
+			buffer_infos[binding].offset = 0;
+			buffer_infos[binding].range = VK_WHOLE_SIZE;
+
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = frame.DescriptorSet;
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorCount = 1;
+			writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[binding].pBufferInfo = &buffer_infos[binding];
+		}
+
+		vkUpdateDescriptorSets(m_Device, 4, writes, 0, nullptr);
+	}
+}
+
+void Engine::CreateVulkanCullingResources()
+{
+	TRACE_FUNCTION();
+
+	VkResult result;
+
+	// Hi-Z Image (level 0 at half resolution, the build keeps the farthest depth of every footprint)
+	{
+		m_HiZExtent.width = std::max(m_SwapchainExtent.width / 2, 1u);
+		m_HiZExtent.height = std::max(m_SwapchainExtent.height / 2, 1u);
+		m_HiZMipCount = static_cast<uint32_t>(std::floor(std::log2(std::max(m_HiZExtent.width, m_HiZExtent.height)))) + 1;
+
+		CreateImage(m_HiZExtent.width, m_HiZExtent.height, m_HiZMipCount, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, m_HiZImage, m_HiZImageMemory);
+
+		m_HiZImageView = CreateImageView(m_HiZImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, m_HiZMipCount);
+
+		for (uint32_t mip = 0; mip < m_HiZMipCount; mip++)
+		{
+			m_HiZMipViews.push_back(CreateImageView(m_HiZImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, mip, 1));
+		}
+
+		// Written and sampled in the general layout from here on
+		SingleTimeCommands commands = BeginSingleTimeCommands();
+		VkCommandBuffer buffer = commands.Buffer;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = m_HiZImage;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = m_HiZMipCount;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		EndSingleTimeCommands(commands);
+	}
+
+	// Hi-Z Sampler (texelFetch in the build, nearest samples per level in culling)
+	{
+		VkSamplerCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		create_info.magFilter = VK_FILTER_NEAREST;
+		create_info.minFilter = VK_FILTER_NEAREST;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.minLod = 0.0f;
+		create_info.maxLod = static_cast<float>(m_HiZMipCount);
+
+		result = vkCreateSampler(m_Device, &create_info, m_Allocator, &m_HiZSampler);
+		check_vk_result(result);
+	}
+
+	// Descriptor Set Layouts
+	{
+		VkDescriptorSetLayoutBinding bindings[2] = {};
+		bindings[0].binding = 0;
+		bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		bindings[0].descriptorCount = 1;
+		bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		bindings[1].binding = 1;
+		bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		bindings[1].descriptorCount = 1;
+		bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		VkDescriptorSetLayoutCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		create_info.bindingCount = 2;
+		create_info.pBindings = bindings;
+
+		result = vkCreateDescriptorSetLayout(m_Device, &create_info, m_Allocator, &m_HiZSetLayout);
+		check_vk_result(result);
+	}
+
+	{
+		// Bounds, instances, visible instances, draw data, states and the Hi-Z
+		VkDescriptorSetLayoutBinding bindings[6] = {};
+
+		for (uint32_t i = 0; i < 6; i++)
+		{
+			bindings[i].binding = i;
+			bindings[i].descriptorType = i < 5 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			bindings[i].descriptorCount = 1;
+			bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+
+		VkDescriptorSetLayoutCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		create_info.bindingCount = 6;
+		create_info.pBindings = bindings;
+
+		result = vkCreateDescriptorSetLayout(m_Device, &create_info, m_Allocator, &m_CullSetLayout);
+		check_vk_result(result);
+	}
+
+	// Descriptor Pool (one set per Hi-Z level and one culling set per frame in flight)
+	{
+		VkDescriptorPoolSize pool_sizes[3] = {};
+		pool_sizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_sizes[0].descriptorCount = m_HiZMipCount + MAX_FRAMES_IN_FLIGHT;
+		pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		pool_sizes[1].descriptorCount = m_HiZMipCount;
+		pool_sizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		pool_sizes[2].descriptorCount = 5 * MAX_FRAMES_IN_FLIGHT;
+
+		VkDescriptorPoolCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		create_info.maxSets = m_HiZMipCount + MAX_FRAMES_IN_FLIGHT;
+		create_info.poolSizeCount = 3;
+		create_info.pPoolSizes = pool_sizes;
+
+		result = vkCreateDescriptorPool(m_Device, &create_info, m_Allocator, &m_DescriptorPool);
+		check_vk_result(result);
+	}
+
+	// Compute Pipelines
+	{
+		VkPushConstantRange hiz_constants = {};
+		hiz_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		hiz_constants.size = sizeof(HiZConstants);
+
+		VkPipelineLayoutCreateInfo pipeline_layout = {};
+		pipeline_layout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout.setLayoutCount = 1;
+		pipeline_layout.pSetLayouts = &m_HiZSetLayout;
+		pipeline_layout.pushConstantRangeCount = 1;
+		pipeline_layout.pPushConstantRanges = &hiz_constants;
+
+		result = vkCreatePipelineLayout(m_Device, &pipeline_layout, m_Allocator, &m_HiZPipelineLayout);
+		check_vk_result(result);
+
+		VkPushConstantRange cull_constants = {};
+		cull_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		cull_constants.size = sizeof(CullConstants);
+
+		pipeline_layout.pSetLayouts = &m_CullSetLayout;
+		pipeline_layout.pPushConstantRanges = &cull_constants;
+
+		result = vkCreatePipelineLayout(m_Device, &pipeline_layout, m_Allocator, &m_CullPipelineLayout);
+		check_vk_result(result);
+
+		VkShaderModule hiz_shader_module = CreateShaderModule("shaders/hiz.spv");
+		VkShaderModule cull_shader_module = CreateShaderModule("shaders/cull.spv");
+
+		VkComputePipelineCreateInfo create_infos[2] = {};
+
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			create_infos[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+			create_infos[i].stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+			create_infos[i].stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			create_infos[i].stage.pName = "main";
+			create_infos[i].basePipelineHandle = VK_NULL_HANDLE;
+			create_infos[i].basePipelineIndex = -1;
+		}
+
+		create_infos[0].stage.module = hiz_shader_module;
+		create_infos[0].layout = m_HiZPipelineLayout;
+		create_infos[1].stage.module = cull_shader_module;
+		create_infos[1].layout = m_CullPipelineLayout;
+
+		VkPipeline pipelines[2];
+		result = vkCreateComputePipelines(m_Device, VK_NULL_HANDLE, 2, create_infos, m_Allocator, pipelines);
+		check_vk_result(result);
+
+		m_HiZPipeline = pipelines[0];
+		m_CullPipeline = pipelines[1];
+
+		vkDestroyShaderModule(m_Device, hiz_shader_module, m_Allocator);
+		vkDestroyShaderModule(m_Device, cull_shader_module, m_Allocator);
+	}
+
+	// Hi-Z Descriptor Sets (level 0 reads the depth buffer, every other level the one above)
+	{
+		std::vector<VkDescriptorSetLayout> layouts(m_HiZMipCount, m_HiZSetLayout);
+		m_HiZDescriptorSets.resize(m_HiZMipCount);
+
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = m_DescriptorPool;
+		alloc_info.descriptorSetCount = m_HiZMipCount;
+		alloc_info.pSetLayouts = layouts.data();
+
+		result = vkAllocateDescriptorSets(m_Device, &alloc_info, m_HiZDescriptorSets.data());
+		check_vk_result(result);
+
+		for (uint32_t mip = 0; mip < m_HiZMipCount; mip++)
+		{
+			VkDescriptorImageInfo input_info = {};
+			input_info.sampler = m_HiZSampler;
+			input_info.imageView = mip == 0 ? m_DepthImageView : m_HiZMipViews[mip - 1];
+			input_info.imageLayout = mip == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+			VkDescriptorImageInfo output_info = {};
+			output_info.imageView = m_HiZMipViews[mip];
+			output_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+			VkWriteDescriptorSet writes[2] = {};
+			writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[0].dstSet = m_HiZDescriptorSets[mip];
+			writes[0].dstBinding = 0;
+			writes[0].descriptorCount = 1;
+			writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			writes[0].pImageInfo = &input_info;
+			writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[1].dstSet = m_HiZDescriptorSets[mip];
+			writes[1].dstBinding = 1;
+			writes[1].descriptorCount = 1;
+			writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+			writes[1].pImageInfo = &output_info;
+
+			vkUpdateDescriptorSets(m_Device, 2, writes, 0, nullptr);
+		}
+	}
+
+	// Per Frame Buffers and Descriptor Sets
+	m_CullingFrames.resize(MAX_FRAMES_IN_FLIGHT);
+
+	VkDeviceSize instance_count = m_Specification.MaxInstances;
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		CullingFrame& frame = m_CullingFrames[i];
+
+		// Written by the transform update like the instance buffer
+		CreateBuffer(instance_count * SCENE_BOUNDS_STRIDE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.BoundsBuffer, frame.BoundsMemory);
+
+		result = vkMapMemory(m_Device, frame.BoundsMemory, 0, instance_count * SCENE_BOUNDS_STRIDE, 0, &frame.BoundsMapped);
+		check_vk_result(result);
+
+		CreateBuffer(instance_count * SCENE_INSTANCE_STRIDE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.VisibleBuffer, frame.VisibleMemory);
+		CreateBuffer(sizeof(CullDrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.DrawDataBuffer, frame.DrawDataMemory);
+		CreateBuffer(instance_count * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, frame.StateBuffer, frame.StateMemory);
+		CreateBuffer(sizeof(CullDrawData), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, frame.ReadbackBuffer, frame.ReadbackMemory);
+
+		result = vkMapMemory(m_Device, frame.ReadbackMemory, 0, sizeof(CullDrawData), 0, &frame.ReadbackMapped);
+		check_vk_result(result);
+
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = m_DescriptorPool;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &m_CullSetLayout;
+
+		result = vkAllocateDescriptorSets(m_Device, &alloc_info, &frame.DescriptorSet);
+		check_vk_result(result);
+
+		VkDescriptorBufferInfo buffer_infos[5] = {};
+		buffer_infos[0].buffer = frame.BoundsBuffer;
+		buffer_infos[1].buffer = m_InstanceBuffers[i];
+		buffer_infos[2].buffer = frame.VisibleBuffer;
+		buffer_infos[3].buffer = frame.DrawDataBuffer;
+		buffer_infos[4].buffer = frame.StateBuffer;
+
+		VkDescriptorImageInfo hiz_info = {};
+		hiz_info.sampler = m_HiZSampler;
+		hiz_info.imageView = m_HiZImageView;
+		hiz_info.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet writes[6] = {};
+
+		for (uint32_t binding = 0; binding < 6; binding++)
+		{
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].dstSet = frame.DescriptorSet;
+			writes[binding].dstBinding = binding;
+			writes[binding].descriptorCount = 1;
+
+			if (binding < 5)
+			{
+				buffer_infos[binding].offset = 0;
+				buffer_infos[binding].range = VK_WHOLE_SIZE;
+
+				writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+				writes[binding].pBufferInfo = &buffer_infos[binding];
+			}
+			else
+			{
+				writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+				writes[binding].pImageInfo = &hiz_info;
+			}
+		}
+
+		vkUpdateDescriptorSets(m_Device, 6, writes, 0, nullptr);
+	}
+}
+
+void Engine::CreateVulkanSpriteResources()
+{
+	TRACE_FUNCTION();
+
+	VkResult result;
+
+	// Descriptor Set Layout and Pool (one combined image sampler per texture)
+	{
+		VkDescriptorSetLayoutBinding binding = {};
+		binding.binding = 0;
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		VkDescriptorSetLayoutCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+		create_info.bindingCount = 1;
+		create_info.pBindings = &binding;
+
+		result = vkCreateDescriptorSetLayout(m_Device, &create_info, m_Allocator, &m_SpriteSetLayout);
+		check_vk_result(result);
+
+		VkDescriptorPoolSize pool_size = {};
+		pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		pool_size.descriptorCount = MAX_SPRITE_TEXTURES;
+
+		VkDescriptorPoolCreateInfo pool_info = {};
+		pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		pool_info.maxSets = MAX_SPRITE_TEXTURES;
+		pool_info.poolSizeCount = 1;
+		pool_info.pPoolSizes = &pool_size;
+
+		result = vkCreateDescriptorPool(m_Device, &pool_info, m_Allocator, &m_SpriteDescriptorPool);
+		check_vk_result(result);
+	}
+
+	// Sampler
+	{
+		VkSamplerCreateInfo create_info = {};
+		create_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+		create_info.magFilter = VK_FILTER_LINEAR;
+		create_info.minFilter = VK_FILTER_LINEAR;
+		create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+		create_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+		create_info.maxLod = 0.0f;
+
+		result = vkCreateSampler(m_Device, &create_info, m_Allocator, &m_SpriteSampler);
+		check_vk_result(result);
+	}
+
+	// Pipeline Layout (texture and the inverse half extent for the pixel to clip space transform)
+	{
+		VkPushConstantRange push_constants = {};
+		push_constants.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+		push_constants.size = 2 * sizeof(float);
+
+		VkPipelineLayoutCreateInfo pipeline_layout = {};
+		pipeline_layout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+		pipeline_layout.setLayoutCount = 1;
+		pipeline_layout.pSetLayouts = &m_SpriteSetLayout;
+		pipeline_layout.pushConstantRangeCount = 1;
+		pipeline_layout.pPushConstantRanges = &push_constants;
+
+		result = vkCreatePipelineLayout(m_Device, &pipeline_layout, m_Allocator, &m_SpritePipelineLayout);
+		check_vk_result(result);
+	}
+
+	// Pipelines, one per blend state
+	{
+		VkShaderModule vert_shader_module = CreateShaderModule("shaders/sprite_vert.spv");
+		VkShaderModule frag_shader_module = CreateShaderModule("shaders/sprite_frag.spv");
+
+		VkPipelineShaderStageCreateInfo shader_stages[2] = {};
+		shader_stages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shader_stages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shader_stages[0].module = vert_shader_module;
+		shader_stages[0].pName = "main";
+		shader_stages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shader_stages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shader_stages[1].module = frag_shader_module;
+		shader_stages[1].pName = "main";
+
+		// Position, texture coordinates and color (SpriteVertex)
+		VkVertexInputBindingDescription vertex_binding = {};
+		vertex_binding.binding = 0;
+		vertex_binding.stride = sizeof(SpriteVertex);
+		vertex_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+		VkVertexInputAttributeDescription vertex_attributes[3] = {};
+		vertex_attributes[0].location = 0;
+		vertex_attributes[0].format = VK_FORMAT_R32G32_SFLOAT;
+		vertex_attributes[0].offset = offsetof(SpriteVertex, Position);
+		vertex_attributes[1].location = 1;
+		vertex_attributes[1].format = VK_FORMAT_R32G32_SFLOAT;
+		vertex_attributes[1].offset = offsetof(SpriteVertex, TexCoord);
+		vertex_attributes[2].location = 2;
+		vertex_attributes[2].format = VK_FORMAT_R8G8B8A8_UNORM;
+		vertex_attributes[2].offset = offsetof(SpriteVertex, Color);
+
+		VkPipelineVertexInputStateCreateInfo vertex_input = {};
+		vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertex_input.vertexBindingDescriptionCount = 1;
+		vertex_input.pVertexBindingDescriptions = &vertex_binding;
+		vertex_input.vertexAttributeDescriptionCount = 3;
+		vertex_input.pVertexAttributeDescriptions = vertex_attributes;
+
+		VkPipelineInputAssemblyStateCreateInfo input_assembly = {};
+		input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+		std::vector<VkDynamicState> dynamic_states = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+		VkPipelineDynamicStateCreateInfo dynamic_state = {};
+		dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		dynamic_state.dynamicStateCount = static_cast<uint32_t>(dynamic_states.size());
+		dynamic_state.pDynamicStates = dynamic_states.data();
+
+		VkPipelineViewportStateCreateInfo viewport_state = {};
+		viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewport_state.viewportCount = 1;
+		viewport_state.scissorCount = 1;
+
+		// Quads can be mirrored by negative sizes
+		VkPipelineRasterizationStateCreateInfo rasterizer = {};
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = VK_CULL_MODE_NONE;
+		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
+
+		VkPipelineMultisampleStateCreateInfo multisample = {};
+		multisample.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisample.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisample.minSampleShading = 1.0f;
+
+		// The overlay ignores the scene's depth
+		VkPipelineDepthStencilStateCreateInfo depth_stencil = {};
+		depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+		depth_stencil.depthTestEnable = VK_FALSE;
+		depth_stencil.depthWriteEnable = VK_FALSE;
+		depth_stencil.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+
+		VkPipelineColorBlendAttachmentState color_blend_attachments[SPRITE_BLEND_COUNT] = {};
+		VkPipelineColorBlendStateCreateInfo color_blends[SPRITE_BLEND_COUNT] = {};
+		VkGraphicsPipelineCreateInfo create_infos[SPRITE_BLEND_COUNT] = {};
+
+		for (uint32_t i = 0; i < SPRITE_BLEND_COUNT; i++)
+		{
+			// Alpha: src * a + dst * (1 - a), additive: src * a + dst
+			bool additive = static_cast<SpriteBlend>(i) == SpriteBlend::Additive;
+
+			VkPipelineColorBlendAttachmentState& attachment = color_blend_attachments[i];
+			attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+			attachment.blendEnable = VK_TRUE;
+			attachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+			attachment.dstColorBlendFactor = additive ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			attachment.colorBlendOp = VK_BLEND_OP_ADD;
+			attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+			attachment.dstAlphaBlendFactor = additive ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+			attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+			VkPipelineColorBlendStateCreateInfo& color_blend = color_blends[i];
+			color_blend.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+			color_blend.logicOp = VK_LOGIC_OP_COPY;
+			color_blend.attachmentCount = 1;
+			color_blend.pAttachments = &attachment;
+
+			VkGraphicsPipelineCreateInfo& create_info = create_infos[i];
+			create_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+			create_info.stageCount = 2;
+			create_info.pStages = shader_stages;
+			create_info.pVertexInputState = &vertex_input;
+			create_info.pInputAssemblyState = &input_assembly;
+			create_info.pViewportState = &viewport_state;
+			create_info.pRasterizationState = &rasterizer;
+			create_info.pMultisampleState = &multisample;
+			create_info.pDepthStencilState = &depth_stencil;
+			create_info.pColorBlendState = &color_blend;
+			create_info.pDynamicState = &dynamic_state;
+			create_info.layout = m_SpritePipelineLayout;
+			create_info.renderPass = m_RenderpassLate;
+			create_info.subpass = 0;
+			create_info.basePipelineHandle = VK_NULL_HANDLE;
+			create_info.basePipelineIndex = -1;
+		}
+
+		result = vkCreateGraphicsPipelines(m_Device, VK_NULL_HANDLE, SPRITE_BLEND_COUNT, create_infos, m_Allocator, m_SpritePipelines);
+		check_vk_result(result);
+
+		vkDestroyShaderModule(m_Device, vert_shader_module, m_Allocator);
+		vkDestroyShaderModule(m_Device, frag_shader_module, m_Allocator);
+	}
+
+	// Index Buffer, the same two triangles per quad for every frame
+	{
+		VkDeviceSize index_count = static_cast<VkDeviceSize>(m_Specification.MaxSprites) * SPRITE_INDICES_PER_QUAD;
+		VkDeviceSize index_size = index_count * sizeof(uint32_t);
+
+		VkBuffer staging_buffer;
+		VkDeviceMemory staging_memory;
+		CreateBuffer(index_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_memory);
+
+		void* staging_data;
+		result = vkMapMemory(m_Device, staging_memory, 0, index_size, 0, &staging_data);
+		check_vk_result(result);
+
+		uint32_t* indices = static_cast<uint32_t*>(staging_data);
+
+		for (uint32_t quad = 0; quad < m_Specification.MaxSprites; quad++)
+		{
+			uint32_t vertex = quad * SPRITE_VERTICES_PER_QUAD;
+			uint32_t* quad_indices = indices + static_cast<size_t>(quad) * SPRITE_INDICES_PER_QUAD;
+
+			quad_indices[0] = vertex;
+			quad_indices[1] = vertex + 1;
+			quad_indices[2] = vertex + 2;
+			quad_indices[3] = vertex + 2;
+			quad_indices[4] = vertex + 3;
+			quad_indices[5] = vertex;
+		}
+
+		vkUnmapMemory(m_Device, staging_memory);
+
+		CreateBuffer(index_size, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_SpriteIndexBuffer, m_SpriteIndexMemory);
+
+		SingleTimeCommands commands = BeginSingleTimeCommands();
+		VkCommandBuffer buffer = commands.Buffer;
+
+		VkBufferCopy copy = {};
+		copy.size = index_size;
+		vkCmdCopyBuffer(buffer, staging_buffer, m_SpriteIndexBuffer, 1, &copy);
+
+		EndSingleTimeCommands(commands);
+
+		vkDestroyBuffer(m_Device, staging_buffer, m_Allocator);
+		m_MemoryBudget.TrackFree(staging_memory);
+		vkFreeMemory(m_Device, staging_memory, m_Allocator);
+	}
+
+	// Streamed Vertex Buffers, written by the batcher every frame and mapped for good
+	{
+		VkDeviceSize vertex_size = static_cast<VkDeviceSize>(m_Specification.MaxSprites) * SPRITE_VERTICES_PER_QUAD * sizeof(SpriteVertex);
+
+		m_SpriteVertexBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+		m_SpriteVertexMemory.resize(MAX_FRAMES_IN_FLIGHT);
+		m_SpriteVertexMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+		{
+			CreateBuffer(vertex_size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_SpriteVertexBuffers[i], m_SpriteVertexMemory[i]);
+
+			result = vkMapMemory(m_Device, m_SpriteVertexMemory[i], 0, vertex_size, 0, &m_SpriteVertexMapped[i]);
+			check_vk_result(result);
+		}
+	}
+
+	// Texture 0, plain white for untextured quads
+	const uint8_t white[4] = { 255, 255, 255, 255 };
+	CreateSpriteTexture(1, 1, white);
+
+	m_SpriteBatcher.Reserve(std::min(m_Specification.MaxSprites, m_Specification.SpriteBenchmarkCount + 1024));
+	m_FrameTimeHistory.resize(FRAME_TIME_HISTORY, 0.0f);
+}
+
+uint32_t Engine::CreateSpriteTexture(uint32_t width, uint32_t height, const uint8_t* pixels)
+{
+	VkResult result;
+
+	if (m_SpriteTextures.size() >= MAX_SPRITE_TEXTURES)
+		throw std::runtime_error("Too many sprite textures.");
+
+	SpriteTexture texture;
+
+	VkDeviceSize size = static_cast<VkDeviceSize>(width) * height * 4;
+
+	VkBuffer staging_buffer;
+	VkDeviceMemory staging_memory;
+	CreateBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, staging_buffer, staging_memory);
+
+	void* staging_data;
+	result = vkMapMemory(m_Device, staging_memory, 0, size, 0, &staging_data);
+	check_vk_result(result);
+
+	std::memcpy(staging_data, pixels, size);
+	vkUnmapMemory(m_Device, staging_memory);
+
+	CreateImage(width, height, 1, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, texture.Image, texture.Memory);
+
+	// Upload and transition for sampling in the fragment shader
+	{
+		SingleTimeCommands commands = BeginSingleTimeCommands();
+		VkCommandBuffer buffer = commands.Buffer;
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = texture.Image;
+		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		barrier.subresourceRange.baseMipLevel = 0;
+		barrier.subresourceRange.levelCount = 1;
+		barrier.subresourceRange.baseArrayLayer = 0;
+		barrier.subresourceRange.layerCount = 1;
+
+		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkBufferImageCopy copy = {};
+		copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copy.imageSubresource.mipLevel = 0;
+		copy.imageSubresource.baseArrayLayer = 0;
+		copy.imageSubresource.layerCount = 1;
+		copy.imageExtent = { width, height, 1 };
+
+		vkCmdCopyBufferToImage(buffer, staging_buffer, texture.Image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		EndSingleTimeCommands(commands);
+	}
+
+	vkDestroyBuffer(m_Device, staging_buffer, m_Allocator);
+	m_MemoryBudget.TrackFree(staging_memory);
+	vkFreeMemory(m_Device, staging_memory, m_Allocator);
+
+	texture.ImageView = CreateImageView(texture.Image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1);
+
+	// Descriptor Set
+	{
+		VkDescriptorSetAllocateInfo alloc_info = {};
+		alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		alloc_info.descriptorPool = m_SpriteDescriptorPool;
+		alloc_info.descriptorSetCount = 1;
+		alloc_info.pSetLayouts = &m_SpriteSetLayout;
+
+		result = vkAllocateDescriptorSets(m_Device, &alloc_info, &texture.DescriptorSet);
+		check_vk_result(result);
+
+		VkDescriptorImageInfo image_info = {};
+		image_info.sampler = m_SpriteSampler;
+		image_info.imageView = texture.ImageView;
+		image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = texture.DescriptorSet;
+		write.dstBinding = 0;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &image_info;
+
+		vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+	}
+
+	m_SpriteTextures.push_back(texture);
+
+	return static_cast<uint32_t>(m_SpriteTextures.size() - 1);
+}
+
+void Engine::CreateScene()
+{
+	TRACE_FUNCTION();
+
+	const uint32_t object_count = SCENE_GRID_SIZE * SCENE_GRID_SIZE;
+
+	if (object_count > m_Specification.MaxInstances)
+		throw std::runtime_error("Scene exceeds the instance buffer capacity.");
+
+	m_Scene.Reserve(object_count);
+
+	float cell_size = 2.0f / SCENE_GRID_SIZE;
+
+	for (uint32_t y = 0; y < SCENE_GRID_SIZE; y++)
+	{
+		for (uint32_t x = 0; x < SCENE_GRID_SIZE; x++)
+		{
+			SceneObjectDesc desc;
+			desc.Position[0] = -1.0f + (x + 0.5f) * cell_size;
+			desc.Position[1] = -1.0f + (y + 0.5f) * cell_size;
+			desc.Scale[0] = desc.Scale[1] = desc.Scale[2] = cell_size;
+
+			m_Scene.CreateObject(desc);
+		}
+	}
+}
+
+void Engine::CreateLights()
+{
+	TRACE_FUNCTION();
+
+	if (m_Specification.LightCount > m_Specification.MaxLights)
+		throw std::runtime_error("Light count exceeds the light buffer capacity.");
+
+	// Fixed seed, every run lights the scene the same way
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> position(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> radius(0.05f, 0.2f);
+	std::uniform_real_distribution<float> color(0.2f, 1.0f);
+
+	// The benchmark uses a prefix of them, so every step shares its lights with the ones before
+	m_Lights.resize(m_Specification.LightBenchmarkFrames != 0 ? m_Specification.MaxLights : m_Specification.LightCount);
+	m_LightBenchmarkCount = std::max(m_Specification.LightCount, 1u);
+
+	for (PointLight& light : m_Lights)
+	{
+		// Slightly in front of the triangles
+		light.Position[0] = position(random);
+		light.Position[1] = position(random);
+		light.Position[2] = -0.05f;
+		light.Radius = radius(random);
+		light.Color[0] = color(random);
+		light.Color[1] = color(random);
+		light.Color[2] = color(random);
+		light.Intensity = 1.0f;
+	}
+}
+
+void Engine::UpdateLights()
+{
+	TRACE_FUNCTION();
+
+	LightingFrame& frame = m_LightingFrames[m_CurrentFrame];
+
+	frame.LightCount = std::min(static_cast<uint32_t>(m_Lights.size()), m_Specification.MaxLights);
+
+	if (m_Specification.LightBenchmarkFrames != 0)
+		frame.LightCount = std::min(frame.LightCount, m_LightBenchmarkCount);
+
+	std::memcpy(frame.LightMapped, m_Lights.data(), frame.LightCount * sizeof(PointLight));
+}
+
+void Engine::RecordLightBenchmark()
+{
+	// Frames still in flight after a step may carry the old count, the readback says which it was
+	const uint32_t light_count = m_LightingStats.LightCount;
+
+	if (m_LightBenchmarkRows.empty() || m_LightBenchmarkRows.back().LightCount != light_count)
+	{
+		m_LightBenchmarkRows.emplace_back();
+		m_LightBenchmarkRows.back().LightCount = light_count;
+	}
+
+	LightingBenchmarkRow& row = m_LightBenchmarkRows.back();
+
+	if (row.FrameCount == m_Specification.LightBenchmarkFrames)
+		return;
+
+	row.MaxClusterLights = std::max(row.MaxClusterLights, m_LightingStats.MaxClusterLights);
+	row.OverflowCount = std::max(row.OverflowCount, m_LightingStats.OverflowCount);
+	row.FrameCount++;
+	row.AccumulatedAssignmentMs += m_LightingStats.AssignmentMs;
+	row.AccumulatedFrameMs += m_LightingStats.FrameMs;
+
+	if (row.FrameCount == m_Specification.LightBenchmarkFrames && m_LightBenchmarkCount < m_Specification.MaxLights)
+	{
+		m_LightBenchmarkCount = std::min(m_LightBenchmarkCount * 2, m_Specification.MaxLights);
+		std::cout << "[Lighting] Benchmark measuring " << m_LightBenchmarkCount << " lights" << std::endl;
+	}
+}
+
+void Engine::UpdateOverlay()
+{
+	TRACE_FUNCTION();
+
+	m_FrameTimeHistory[m_FrameTimeCursor] = static_cast<float>(m_LightingStats.FrameMs);
+	m_FrameTimeCursor = (m_FrameTimeCursor + 1) % FRAME_TIME_HISTORY;
+
+	// HUD, GPU frame time graph in the top left corner with a line at 60 Hz
+	const float graph_height = 100.0f;
+	const float bar_width = 3.0f;
+
+	SpriteQuad panel;
+	panel.Position[0] = 16.0f;
+	panel.Position[1] = 16.0f;
+	panel.Size[0] = FRAME_TIME_HISTORY * bar_width + 8.0f;
+	panel.Size[1] = graph_height + 8.0f;
+	panel.Color = 0xB0000000;
+	m_SpriteBatcher.DrawQuad(panel);
+
+	for (uint32_t i = 0; i < FRAME_TIME_HISTORY; i++)
+	{
+		float frame_ms = m_FrameTimeHistory[(m_FrameTimeCursor + i) % FRAME_TIME_HISTORY];
+		float height = std::min(frame_ms * FRAME_TIME_GRAPH_PIXELS_PER_MS, graph_height);
+
+		SpriteQuad bar;
+		bar.Position[0] = 20.0f + i * bar_width;
+		bar.Position[1] = 20.0f + graph_height - height;
+		bar.Size[0] = bar_width - 1.0f;
+		bar.Size[1] = height;
+		bar.Color = frame_ms < 1000.0f / 60.0f ? 0xFF40D040 : 0xFF4040E0;
+		bar.Layer = 1;
+		m_SpriteBatcher.DrawQuad(bar);
+	}
+
+	SpriteQuad line;
+	line.Position[0] = 20.0f;
+	line.Position[1] = 20.0f + graph_height - 1000.0f / 60.0f * FRAME_TIME_GRAPH_PIXELS_PER_MS;
+	line.Size[0] = FRAME_TIME_HISTORY * bar_width;
+	line.Size[1] = 1.0f;
+	line.Color = 0x80FFFFFF;
+	line.Blend = SpriteBlend::Additive;
+	line.Layer = 2;
+	m_SpriteBatcher.DrawQuad(line);
+
+	// Stress test, small additive quads drifting across the screen
+	const float width = static_cast<float>(m_SwapchainExtent.width);
+	const float height = static_cast<float>(m_SwapchainExtent.height);
+	const float time = m_FrameCounter * 0.01f;
+
+	for (uint32_t i = 0; i < m_Specification.SpriteBenchmarkCount; i++)
+	{
+		uint32_t hash = i * 2654435761u;
+
+		SpriteQuad quad;
+		quad.Position[0] = std::fmod((hash & 0xFFFF) / 65535.0f * width + time * 50.0f, width);
+		quad.Position[1] = (hash >> 16) / 65535.0f * height;
+		quad.Size[0] = 4.0f;
+		quad.Size[1] = 4.0f;
+		quad.Color = 0x40000000 | (hash & 0x00FFFFFF);
+		quad.Blend = SpriteBlend::Additive;
+		m_SpriteBatcher.DrawQuad(quad);
+	}
+
+	// This frame's vertex buffer is no longer read by the GPU
+	m_SpriteBatcher.Build(m_JobSystem, static_cast<SpriteVertex*>(m_SpriteVertexMapped[m_CurrentFrame]), m_Specification.MaxSprites);
+}
+
+void Engine::UpdateScene()
+{
+	TRACE_FUNCTION();
+
+	float time = m_FrameCounter * 0.01f;
+
+	// Spin every object around the z axis
+	m_JobSystem.ParallelFor(m_Scene.GetObjectCount(), 4096, [&](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			float half_angle = 0.5f * (time + i * 0.001f);
+			m_Scene.SetRotation(i, 0.0f, 0.0f, std::sin(half_angle), std::cos(half_angle));
+		}
+	});
+
+	m_Scene.UpdateTransforms(m_JobSystem, m_InstanceBufferMapped[m_CurrentFrame], m_CullingFrames[m_CurrentFrame].BoundsMapped);
+
+	m_FrameCounter++;
+}
+
+void Engine::RenderFrame()
+{
+	TRACE_FUNCTION();
+
+	VkResult result;
+
+	uint64_t frame_allocations = m_HostAllocator.GetAllocationCount();
+
+	{
+		TRACE_SCOPE("Wait For Frame");
+		auto sync_start = std::chrono::high_resolution_clock::now();
+
+		if (m_TimelineQueue.IsInitialized())
+		{
+			// No call at all when the slot's value is already known to be reached
+			uint64_t blocking_waits = m_TimelineQueue.GetStats().BlockingWaitCount;
+			m_TimelineQueue.Wait(m_FramePoints[m_CurrentFrame]);
+			m_FrameSyncStats.CallCount += m_TimelineQueue.GetStats().BlockingWaitCount - blocking_waits;
+		}
+		else
+		{
+			vkWaitForFences(m_Device, 1, &m_FencesInFlight[m_CurrentFrame], VK_TRUE, UINT64_MAX);
+			vkResetFences(m_Device, 1, &m_FencesInFlight[m_CurrentFrame]);
+			m_FrameSyncStats.CallCount += 2;
+		}
+
+		m_FrameSyncStats.LastMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - sync_start).count();
+		m_FrameSyncStats.AccumulatedMs += m_FrameSyncStats.LastMs;
+		m_FrameSyncStats.FrameCount++;
+	}
+
+	// Submissions finish in order, so everything up to this slot's frame is done
+	m_CompletedFrame = std::max(m_CompletedFrame, m_FenceFrames[m_CurrentFrame]);
+	m_DeletionQueue.Flush(m_TimelineQueue.IsInitialized() ? m_TimelineQueue.GetCompleted() : m_CompletedFrame);
+
+	// Meshes not requested since the last frame are evicted first, their memory follows the deletion queue
+	m_MemoryBudget.Update();
+	m_Residency.Enforce(m_MemoryBudget, m_FrameCounter, m_CompletedFrame);
+
+	// The instance and culling buffers of this frame are no longer used by the GPU
+	ReadCullingStats();
+	ReadLightingStats();
+	UpdateScene();
+	UpdateLights();
+	UpdateOverlay();
+	RequestResidencyStress();
+
+	// Handles released from here on may still be used by this frame
+	m_DeletionQueue.SetRetireValue(m_TimelineQueue.IsInitialized() ? m_TimelineQueue.GetNextValue() : m_FrameCounter);
+
+	uint32_t image_index;
+
+	{
+		TRACE_SCOPE("Acquire Next Image");
+		result = vkAcquireNextImageKHR(m_Device, m_Swapchain, UINT64_MAX, m_SemaphoresImageAvailable[m_CurrentFrame], VK_NULL_HANDLE, &image_index);
+		check_vk_result(result);
+	}
+
+	uint64_t reset_allocations = m_HostAllocator.GetAllocationCount();
+	vkResetCommandBuffer(m_CommandBuffers[m_CurrentFrame], 0);
+
+	uint64_t record_allocations = m_HostAllocator.GetAllocationCount();
+	RecordCommandBuffer(m_CommandBuffers[m_CurrentFrame], image_index);
+
+	uint64_t submit_allocations = m_HostAllocator.GetAllocationCount();
 
 	// Submitting the command buffer
 	VkSubmitInfo submit_info = {};
@@ -720,8 +2933,29 @@ void Engine::RenderFrame()
 	submit_info.signalSemaphoreCount = 1;
 	submit_info.pSignalSemaphores = signal_semaphores;
 
-	result = vkQueueSubmit(m_Queue, 1, &submit_info, m_FencesInFlight[m_CurrentFrame]);
-	check_vk_result(result);
+	{
+		TRACE_SCOPE("Queue Submit");
+
+		if (m_TimelineQueue.IsInitialized())
+		{
+			TimelineSubmitInfo timeline_submit;
+			timeline_submit.CommandBuffers = std::span<const VkCommandBuffer>(&m_CommandBuffers[m_CurrentFrame], 1);
+			timeline_submit.WaitSemaphore = wait_semaphores[0];
+			timeline_submit.WaitSemaphoreStage = wait_stages[0];
+			timeline_submit.SignalSemaphore = signal_semaphores[0];
+
+			m_FramePoints[m_CurrentFrame] = m_TimelineQueue.Submit(timeline_submit);
+		}
+		else
+		{
+			result = vkQueueSubmit(m_Queue, 1, &submit_info, m_FencesInFlight[m_CurrentFrame]);
+			check_vk_result(result);
+		}
+	}
+
+	m_FenceFrames[m_CurrentFrame] = m_FrameCounter;
+	m_CullingFrames[m_CurrentFrame].Submitted = true;
+	m_LightingFrames[m_CurrentFrame].Submitted = true;
 
 
 	// Present Image
@@ -736,14 +2970,34 @@ void Engine::RenderFrame()
 	present_info.pImageIndices = &image_index;
 	present_info.pResults = nullptr;
 
-	result = vkQueuePresentKHR(m_Queue, &present_info);
-	check_vk_result(result);
+	{
+		TRACE_SCOPE("Queue Present");
+		result = vkQueuePresentKHR(m_Queue, &present_info);
+		check_vk_result(result);
+	}
+
+	if (m_StartupStats.FirstFrameMs == 0.0)
+	{
+		m_StartupStats.FirstFrameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_StartupTime).count();
+		std::cout << "[Startup] First frame presented after " << m_StartupStats.FirstFrameMs << " ms" << std::endl;
+	}
+
+	uint64_t end_allocations = m_HostAllocator.GetAllocationCount();
+
+	m_HostFrameStats.ResetCommandBuffer = record_allocations - reset_allocations;
+	m_HostFrameStats.RecordCommandBuffer = submit_allocations - record_allocations;
+	m_HostFrameStats.SubmitAndPresent = end_allocations - submit_allocations;
+	m_HostFrameStats.Frame = end_allocations - frame_allocations;
+	m_HostFrameStats.FrameCount++;
+	m_HostFrameStats.AccumulatedFrame += m_HostFrameStats.Frame;
 
 	m_CurrentFrame = (m_CurrentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
 }
 
 void Engine::SetupSDL()
 {
+	TRACE_FUNCTION();
+
 	SDL_Init(SDL_INIT_VIDEO);
 
 	m_WindowHandle = SDL_CreateWindow(m_Specification.Name.c_str(), SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, m_Specification.Width, m_Specification.Height, SDL_WINDOW_VULKAN);
@@ -763,6 +3017,8 @@ void Engine::SetupSDL()
 
 void Engine::CreateSDLSurface()
 {
+	TRACE_FUNCTION();
+
 	if (SDL_Vulkan_CreateSurface(m_WindowHandle, m_Instance, &m_Surface) == SDL_FALSE)
 	{
 		throw std::runtime_error("Error creating Vulkan Surface.");
@@ -791,16 +3047,78 @@ Engine& Engine::Get()
 
 void Engine::Init()
 {
-	SetupSDL();
-	CreateVulkanInstance();
-	CreateSDLSurface();
-	SetupVulkan();
-	CreateVulkanRenderPass();
-	CreateVulkanGraphicsPipeline();
-	CreateVulkanFramebuffers();
-	CreateVulkanCommandPool();
-	CreateVulkanCommandBuffers();
-	CreateVulkanSyncObjects();
+	m_StartupTime = std::chrono::high_resolution_clock::now();
+
+	if (!m_Specification.TracePath.empty())
+	{
+		Tracer::Get().Enable();
+		Tracer::Get().SetThreadName("Main");
+	}
+
+	TRACE_FUNCTION();
+
+	// Startup as a dependency graph. Reading the SPIR-V and building the scene overlap instance
+	// and device creation, the pipelines compile side by side once the device exists. SDL gets
+	// its window and surface created on the main thread.
+	TaskGraph graph;
+
+	uint32_t archive = graph.AddTask("Asset Archive", [this]() { OpenAssetArchive(); });
+	uint32_t sdl = graph.AddTask("SDL", [this]() { SetupSDL(); }, {}, TaskThread::Main);
+	uint32_t instance = graph.AddTask("Instance", [this]() { CreateVulkanInstance(); }, { sdl });
+	uint32_t surface = graph.AddTask("Surface", [this]() { CreateSDLSurface(); }, { instance }, TaskThread::Main);
+	uint32_t device = graph.AddTask("Device", [this]() { SetupVulkan(); }, { instance, surface });
+
+	graph.AddTask("Scene", [this]() { CreateScene(); });
+	graph.AddTask("Lights", [this]() { CreateLights(); });
+
+	// Every shader gets its own entry up front, the tasks only fill in their own
+	std::vector<uint32_t> shaders;
+
+	for (const char* name : STARTUP_SHADERS)
+	{
+		ShaderCode& shader = m_ShaderCode[name];
+		shaders.push_back(graph.AddTask(name, [this, name, &shader]() { shader.Code = LoadAsset(name, shader.Storage); }, { archive }));
+	}
+
+	auto with_shaders = [&](std::vector<uint32_t> dependencies)
+	{
+		dependencies.insert(dependencies.end(), shaders.begin(), shaders.end());
+		return dependencies;
+	};
+
+	uint32_t render_pass = graph.AddTask("Render Pass", [this]() { CreateVulkanRenderPass(); }, { device });
+	uint32_t depth = graph.AddTask("Depth Resources", [this]() { CreateVulkanDepthResources(); }, { device });
+	uint32_t command_pool = graph.AddTask("Command Pool", [this]() { CreateVulkanCommandPool(); }, { device });
+	uint32_t instance_buffers = graph.AddTask("Instance Buffers", [this]() { CreateVulkanInstanceBuffers(); }, { device });
+	uint32_t lighting = graph.AddTask("Lighting Resources", [this]() { CreateVulkanLightingResources(); }, with_shaders({ device }));
+
+	graph.AddTask("Command Buffers", [this]() { CreateVulkanCommandBuffers(); }, { command_pool });
+	graph.AddTask("Sync Objects", [this]() { CreateVulkanSyncObjects(); }, { device });
+	graph.AddTask("Graphics Pipeline", [this]() { CreateVulkanGraphicsPipeline(); }, with_shaders({ render_pass, lighting }));
+	graph.AddTask("Framebuffers", [this]() { CreateVulkanFramebuffers(); }, { render_pass, depth });
+	graph.AddTask("Culling Resources", [this]() { CreateVulkanCullingResources(); }, with_shaders({ depth, command_pool, instance_buffers }));
+	graph.AddTask("Sprite Resources", [this]() { CreateVulkanSpriteResources(); }, with_shaders({ render_pass, command_pool }));
+
+	if (Tracer::IsEnabled())
+		graph.AddTask("Calibrate GPU Clock", [this]() { CalibrateGpuClock(); }, { command_pool, lighting });
+
+	graph.Run(m_JobSystem);
+
+	// Every module was created, later loads read from the archive again
+	m_ShaderCode.clear();
+
+	LoadResidencyStress();
+
+	const TaskGraphStats& stats = graph.GetStats();
+	m_StartupStats.TaskCount = stats.TaskCount;
+	m_StartupStats.ThreadCount = stats.ThreadCount;
+	m_StartupStats.TaskMs = stats.TaskMs;
+	m_StartupStats.CriticalPathMs = stats.CriticalPathMs;
+	m_StartupStats.InitMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_StartupTime).count();
+
+	std::cout << "[Startup] " << stats.TaskCount << " tasks on " << stats.ThreadCount << " threads in " << m_StartupStats.InitMs << " ms ("
+		<< stats.TaskMs << " ms in sequence, critical path " << stats.CriticalPathMs << " ms, assets from "
+		<< (m_AssetArchive.IsOpen() ? "archive" : "loose files") << ")" << std::endl;
 }
 
 void Engine::Run()
@@ -821,31 +3139,233 @@ void Engine::Run()
 
 void Engine::Shutdown()
 {
+	// The workers are idle and the GPU zones of the last frames were read, nothing records anymore
+	if (Tracer::IsEnabled())
+	{
+		Tracer::Get().Disable();
+
+		try
+		{
+			uint64_t event_count = Tracer::Get().WriteChromeTrace(m_Specification.TracePath);
+			std::cout << "[Trace] " << event_count << " zones written to " << m_Specification.TracePath << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
+	// Run waited for the device to go idle
+	m_DeletionQueue.FlushAll();
+
+	DeletionQueueStats deletion = m_DeletionQueue.GetStats();
+	std::cout << "[Deletion Queue] " << deletion.DestroyedCount << " handles destroyed in " << deletion.BatchCount << " batches, "
+		<< deletion.ReclaimedBytes << " bytes reclaimed, peak depth " << deletion.PeakQueueDepth << std::endl;
+
+	for (uint32_t i = 0; i < m_MemoryBudget.GetHeapCount(); i++)
+	{
+		const MemoryHeapBudget& heap = m_MemoryBudget.GetHeap(i);
+		std::cout << "[Memory] Heap " << i << (heap.DeviceLocal ? " (device local): " : ": ") << heap.Usage / (1024 * 1024) << " MB used, "
+			<< heap.PeakUsage / (1024 * 1024) << " MB peak, " << heap.Budget / (1024 * 1024) << " MB budget, " << heap.Size / (1024 * 1024) << " MB size"
+			<< (m_MemoryBudget.HasBudgetExtension() ? "" : " (estimated)") << std::endl;
+	}
+
+	const ResidencyStats& residency = m_Residency.GetStats();
+	std::cout << "[Memory] " << residency.ResidentCount << "/" << residency.ResourceCount << " meshes resident (" << residency.ResidentBytes << " bytes), "
+		<< residency.EvictionCount << " evictions (" << residency.EvictedBytes << " bytes), " << residency.RestoreCount << " restores, "
+		<< residency.FramesOverBudget << " frames over budget" << std::endl;
+
+	const SceneUpdateStats& stats = m_Scene.GetStats();
+	std::cout << "[Scene] " << stats.ObjectCount << " objects, " << stats.TotalMs << " ms last update, "
+		<< stats.ObjectsPerSecondPerCore << " objects/s per core (" << stats.ThreadCount << " threads)" << std::endl;
+
+	const OcclusionCullingStats& culling = m_CullingStats;
+	std::cout << "[Culling] " << culling.Instances << " instances, " << culling.FrustumCulled << " frustum culled, "
+		<< culling.Occluded << " occlusion culled (" << culling.OccludedEarly << " after phase 0), "
+		<< culling.VisibleEarly << " drawn early, " << culling.Disoccluded << " drawn late" << std::endl;
+
+	const LightingStats& lighting = m_LightingStats;
+	double frame_count = static_cast<double>(std::max<uint64_t>(lighting.FrameCount, 1));
+	std::cout << "[Lighting] " << lighting.LightCount << " lights, " << lighting.ClusterCount << " clusters, "
+		<< lighting.AccumulatedAssignmentMs / frame_count << " ms light assignment, " << lighting.AccumulatedFrameMs / frame_count << " ms frame (GPU average), "
+		<< lighting.LightIndexCount << " light references, " << lighting.MaxClusterLights << " max per cluster, " << lighting.OverflowCount << " dropped" << std::endl;
+
+	for (const LightingBenchmarkRow& row : m_LightBenchmarkRows)
+	{
+		double row_frames = static_cast<double>(std::max<uint64_t>(row.FrameCount, 1));
+		std::cout << "[Lighting] Benchmark " << row.LightCount << " lights: " << row.AccumulatedAssignmentMs / row_frames << " ms light assignment, "
+			<< row.AccumulatedFrameMs / row_frames << " ms frame over " << row.FrameCount << " frames, " << row.MaxClusterLights << " max per cluster, "
+			<< row.OverflowCount << " dropped" << std::endl;
+	}
+
+	const SpriteBatchStats& sprites = m_SpriteBatcher.GetStats();
+	double build_count = static_cast<double>(std::max<uint64_t>(sprites.BuildCount, 1));
+	std::cout << "[Sprites] " << sprites.QuadCount << " quads in " << sprites.BatchCount << " draws, " << sprites.DroppedCount << " dropped, "
+		<< sprites.AccumulatedMs / build_count << " ms to batch on average (" << sprites.AccumulatedQuads / build_count << " quads)" << std::endl;
+
+	for (SpriteTexture& texture : m_SpriteTextures)
+	{
+		vkDestroyImageView(m_Device, texture.ImageView, m_Allocator);
+		vkDestroyImage(m_Device, texture.Image, m_Allocator);
+		vkFreeMemory(m_Device, texture.Memory, m_Allocator);
+	}
+
+	for (size_t i = 0; i < m_SpriteVertexBuffers.size(); i++)
+	{
+		vkUnmapMemory(m_Device, m_SpriteVertexMemory[i]);
+		vkDestroyBuffer(m_Device, m_SpriteVertexBuffers[i], m_Allocator);
+		vkFreeMemory(m_Device, m_SpriteVertexMemory[i], m_Allocator);
+	}
+
+	vkDestroyBuffer(m_Device, m_SpriteIndexBuffer, m_Allocator);
+	vkFreeMemory(m_Device, m_SpriteIndexMemory, m_Allocator);
+
+	for (VkPipeline pipeline : m_SpritePipelines)
+	{
+		vkDestroyPipeline(m_Device, pipeline, m_Allocator);
+	}
+
+	vkDestroyPipelineLayout(m_Device, m_SpritePipelineLayout, m_Allocator);
+	vkDestroySampler(m_Device, m_SpriteSampler, m_Allocator);
+	vkDestroyDescriptorPool(m_Device, m_SpriteDescriptorPool, m_Allocator);
+	vkDestroyDescriptorSetLayout(m_Device, m_SpriteSetLayout, m_Allocator);
+
+	for (LightingFrame& frame : m_LightingFrames)
+	{
+		vkUnmapMemory(m_Device, frame.LightMemory);
+		vkDestroyBuffer(m_Device, frame.LightBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.LightMemory, m_Allocator);
+		vkDestroyBuffer(m_Device, frame.ClusterBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.ClusterMemory, m_Allocator);
+		vkDestroyBuffer(m_Device, frame.LightIndexBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.LightIndexMemory, m_Allocator);
+		vkDestroyBuffer(m_Device, frame.ClusterDataBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.ClusterDataMemory, m_Allocator);
+		vkUnmapMemory(m_Device, frame.ReadbackMemory);
+		vkDestroyBuffer(m_Device, frame.ReadbackBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.ReadbackMemory, m_Allocator);
+		vkDestroyQueryPool(m_Device, frame.TimestampPool, m_Allocator);
+	}
+
+	vkDestroyPipeline(m_Device, m_ClusterPipeline, m_Allocator);
+	vkDestroyPipelineLayout(m_Device, m_ClusterPipelineLayout, m_Allocator);
+	vkDestroyDescriptorPool(m_Device, m_LightingDescriptorPool, m_Allocator);
+	vkDestroyDescriptorSetLayout(m_Device, m_LightingSetLayout, m_Allocator);
+
+	for (CullingFrame& frame : m_CullingFrames)
+	{
+		vkUnmapMemory(m_Device, frame.BoundsMemory);
+		vkDestroyBuffer(m_Device, frame.BoundsBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.BoundsMemory, m_Allocator);
+		vkDestroyBuffer(m_Device, frame.VisibleBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.VisibleMemory, m_Allocator);
+		vkDestroyBuffer(m_Device, frame.DrawDataBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.DrawDataMemory, m_Allocator);
+		vkDestroyBuffer(m_Device, frame.StateBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.StateMemory, m_Allocator);
+		vkUnmapMemory(m_Device, frame.ReadbackMemory);
+		vkDestroyBuffer(m_Device, frame.ReadbackBuffer, m_Allocator);
+		vkFreeMemory(m_Device, frame.ReadbackMemory, m_Allocator);
+	}
+
+	vkDestroyPipeline(m_Device, m_HiZPipeline, m_Allocator);
+	vkDestroyPipeline(m_Device, m_CullPipeline, m_Allocator);
+	vkDestroyPipelineLayout(m_Device, m_HiZPipelineLayout, m_Allocator);
+	vkDestroyPipelineLayout(m_Device, m_CullPipelineLayout, m_Allocator);
+	vkDestroyDescriptorPool(m_Device, m_DescriptorPool, m_Allocator);
+	vkDestroyDescriptorSetLayout(m_Device, m_HiZSetLayout, m_Allocator);
+	vkDestroyDescriptorSetLayout(m_Device, m_CullSetLayout, m_Allocator);
+	vkDestroySampler(m_Device, m_HiZSampler, m_Allocator);
+
+	for (VkImageView image_view : m_HiZMipViews)
+	{
+		vkDestroyImageView(m_Device, image_view, m_Allocator);
+	}
+
+	vkDestroyImageView(m_Device, m_HiZImageView, m_Allocator);
+	vkDestroyImage(m_Device, m_HiZImage, m_Allocator);
+	vkFreeMemory(m_Device, m_HiZImageMemory, m_Allocator);
+
+	vkDestroyImageView(m_Device, m_DepthImageView, m_Allocator);
+	vkDestroyImage(m_Device, m_DepthImage, m_Allocator);
+	vkFreeMemory(m_Device, m_DepthImageMemory, m_Allocator);
+
+	for (const MeshCopy& copy : m_MeshCopies)
+	{
+		vkDestroyBuffer(m_Device, copy.StagingBuffer, m_Allocator);
+		vkFreeMemory(m_Device, copy.StagingMemory, m_Allocator);
+	}
+
+	for (GpuMesh& mesh : m_Meshes)
+	{
+		vkDestroyBuffer(m_Device, mesh.VertexBuffer, m_Allocator);
+		vkFreeMemory(m_Device, mesh.VertexMemory, m_Allocator);
+		vkDestroyBuffer(m_Device, mesh.IndexBuffer, m_Allocator);
+		vkFreeMemory(m_Device, mesh.IndexMemory, m_Allocator);
+	}
+
+	for (size_t i = 0; i < m_InstanceBuffers.size(); i++)
+	{
+		vkUnmapMemory(m_Device, m_InstanceBufferMemory[i]);
+		vkDestroyBuffer(m_Device, m_InstanceBuffers[i], m_Allocator);
+		vkFreeMemory(m_Device, m_InstanceBufferMemory[i], m_Allocator);
+	}
+
 	for (VkFramebuffer framebuffer : m_SwapchainFramebuffers)
 	{
-		vkDestroyFramebuffer(m_Device, framebuffer, nullptr);
+		vkDestroyFramebuffer(m_Device, framebuffer, m_Allocator);
 	}
 
 	for (VkImageView image_view : m_SwapchainImageViews)
 	{
-		vkDestroyImageView(m_Device, image_view, nullptr);
+		vkDestroyImageView(m_Device, image_view, m_Allocator);
 	}
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		vkDestroySemaphore(m_Device, m_SemaphoresImageAvailable[i], nullptr);
-		vkDestroySemaphore(m_Device, m_SemaphoresRenderFinished[i], nullptr);
-		vkDestroyFence(m_Device, m_FencesInFlight[i], nullptr);
+		vkDestroySemaphore(m_Device, m_SemaphoresImageAvailable[i], m_Allocator);
+		vkDestroySemaphore(m_Device, m_SemaphoresRenderFinished[i], m_Allocator);
+		vkDestroyFence(m_Device, m_FencesInFlight[i], m_Allocator);
 	}
 
-	vkDestroyCommandPool(m_Device, m_CommandPool, nullptr);
-	vkDestroyPipeline(m_Device, m_Pipeline, nullptr);
-	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, nullptr);
-	vkDestroyRenderPass(m_Device, m_Renderpass, nullptr);
-	vkDestroySwapchainKHR(m_Device, m_Swapchain, nullptr);
+	m_TimelineQueue.Destroy();
+
+	vkDestroyCommandPool(m_Device, m_CommandPool, m_Allocator);
+	vkDestroyPipeline(m_Device, m_Pipeline, m_Allocator);
+	vkDestroyPipelineLayout(m_Device, m_PipelineLayout, m_Allocator);
+	vkDestroyRenderPass(m_Device, m_Renderpass, m_Allocator);
+	vkDestroyRenderPass(m_Device, m_RenderpassLate, m_Allocator);
+	vkDestroySwapchainKHR(m_Device, m_Swapchain, m_Allocator);
 	vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
-	vkDestroyDevice(m_Device, nullptr);
-	vkDestroyInstance(m_Instance, nullptr);
+	vkDestroyDevice(m_Device, m_Allocator);
+	vkDestroyInstance(m_Instance, m_Allocator);
+
+	// Everything is destroyed, anything still allocated leaked
+	HostAllocatorStats host_stats = m_HostAllocator.GetStats();
+	std::cout << "[Host Allocations] " << m_HostFrameStats.AccumulatedFrame / std::max<uint64_t>(m_HostFrameStats.FrameCount, 1) << " per frame on average, last frame "
+		<< m_HostFrameStats.ResetCommandBuffer << " in vkResetCommandBuffer, " << m_HostFrameStats.RecordCommandBuffer << " recording, "
+		<< m_HostFrameStats.SubmitAndPresent << " submit and present" << std::endl;
+
+	const FrameSyncStats& sync = m_FrameSyncStats;
+	const double sync_frames = static_cast<double>(std::max<uint64_t>(sync.FrameCount, 1));
+	std::cout << "[Sync] " << (sync.Timeline ? "Timeline semaphore" : "Fences") << ": " << sync.AccumulatedMs * 1000.0 / sync_frames
+		<< " us per frame waiting for the frame slot, " << sync.CallCount / sync_frames << " calls per frame";
+
+	if (sync.Timeline)
+		std::cout << ", " << m_TimelineQueue.GetStats().SubmitCount << " submits up to value " << m_TimelineQueue.GetLastSubmitted();
+
+	std::cout << std::endl;
+
+	for (uint32_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++)
+	{
+		const HostAllocationScopeStats& scope = host_stats.Scopes[i];
+		std::cout << "[Host Allocations] " << GetHostAllocationScopeName(i) << ": " << scope.AllocationCount << " allocations, "
+			<< scope.ReallocationCount << " reallocations, " << scope.FreeCount << " frees, " << scope.AllocatedBytes << " bytes total, "
+			<< scope.PeakBytes << " bytes peak, " << scope.CurrentBytes << " bytes leaked, " << scope.InternalAllocationCount << " internal" << std::endl;
+	}
+
+	std::cout << "[Host Allocations] " << host_stats.ArenaAllocationCount << " command scope allocations from " << host_stats.ArenaCount
+		<< " thread arenas, " << host_stats.ArenaFallbackCount << " fell back to the heap" << std::endl;
 
 	SDL_DestroyWindow(m_WindowHandle);
 	SDL_Quit();
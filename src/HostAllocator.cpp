@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <unordered_map>
+
+#include "HostAllocator.h"
+
+// Stored right in front of every allocation, Vulkan doesn't pass the size to pfnFree
+struct AllocationHeader
+{
+	uint64_t Size;
+	uint32_t Alignment;
+	uint32_t Scope;
+	void* Arena;		// Null for heap allocations
+};
+
+struct HostAllocator::Arena
+{
+	uint8_t* Memory = nullptr;
+	size_t Offset = 0;	// Only touched by the owning thread
+
+	// Frees can come from any thread, the owner rewinds once nothing is left
+	std::atomic<uint32_t> LiveCount{ 0 };
+};
+
+static std::atomic<uint64_t> s_NextAllocatorId{ 1 };
+
+static size_t AlignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static AllocationHeader* GetHeader(void* memory)
+{
+	return reinterpret_cast<AllocationHeader*>(static_cast<uint8_t*>(memory) - sizeof(AllocationHeader));
+}
+
+static uint32_t GetScopeIndex(VkSystemAllocationScope scope)
+{
+	return std::min(static_cast<uint32_t>(scope), HOST_ALLOCATION_SCOPE_COUNT - 1);
+}
+
+uint64_t HostAllocatorStats::GetAllocationCount() const
+{
+	uint64_t count = 0;
+
+	for (const HostAllocationScopeStats& scope : Scopes)
+	{
+		count += scope.AllocationCount + scope.ReallocationCount;
+	}
+
+	return count;
+}
+
+uint64_t HostAllocatorStats::GetAllocatedBytes() const
+{
+	uint64_t bytes = 0;
+
+	for (const HostAllocationScopeStats& scope : Scopes)
+	{
+		bytes += scope.AllocatedBytes;
+	}
+
+	return bytes;
+}
+
+const char* GetHostAllocationScopeName(uint32_t scope)
+{
+	const char* names[HOST_ALLOCATION_SCOPE_COUNT] = { "Command", "Object", "Cache", "Device", "Instance" };
+
+	return scope < HOST_ALLOCATION_SCOPE_COUNT ? names[scope] : "Unknown";
+}
+
+HostAllocator::HostAllocator()
+	: m_Id(s_NextAllocatorId.fetch_add(1))
+{
+	m_Callbacks.pUserData = this;
+	m_Callbacks.pfnAllocation = &HostAllocator::Allocate;
+	m_Callbacks.pfnReallocation = &HostAllocator::Reallocate;
+	m_Callbacks.pfnFree = &HostAllocator::Free;
+	m_Callbacks.pfnInternalAllocation = &HostAllocator::InternalAllocation;
+	m_Callbacks.pfnInternalFree = &HostAllocator::InternalFree;
+}
+
+HostAllocator::~HostAllocator()
+{
+	for (Arena* arena : m_Arenas)
+	{
+		::operator delete(arena->Memory, std::align_val_t(64));
+		delete arena;
+	}
+}
+
+HostAllocatorStats HostAllocator::GetStats() const
+{
+	HostAllocatorStats stats;
+
+	for (uint32_t i = 0; i < HOST_ALLOCATION_SCOPE_COUNT; i++)
+	{
+		const ScopeCounters& counters = m_Scopes[i];
+		HostAllocationScopeStats& scope = stats.Scopes[i];
+
+		scope.AllocationCount = counters.AllocationCount.load(std::memory_order_relaxed);
+		scope.ReallocationCount = counters.ReallocationCount.load(std::memory_order_relaxed);
+		scope.FreeCount = counters.FreeCount.load(std::memory_order_relaxed);
+		scope.AllocatedBytes = counters.AllocatedBytes.load(std::memory_order_relaxed);
+		scope.CurrentBytes = counters.CurrentBytes.load(std::memory_order_relaxed);
+		scope.PeakBytes = counters.PeakBytes.load(std::memory_order_relaxed);
+		scope.InternalAllocationCount = counters.InternalAllocationCount.load(std::memory_order_relaxed);
+		scope.InternalBytes = counters.InternalBytes.load(std::memory_order_relaxed);
+	}
+
+	stats.ArenaAllocationCount = m_ArenaAllocationCount.load(std::memory_order_relaxed);
+	stats.ArenaFallbackCount = m_ArenaFallbackCount.load(std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> lock(m_ArenaMutex);
+		stats.ArenaCount = m_Arenas.size();
+	}
+
+	return stats;
+}
+
+uint64_t HostAllocator::GetAllocationCount() const
+{
+	uint64_t count = 0;
+
+	for (const ScopeCounters& counters : m_Scopes)
+	{
+		count += counters.AllocationCount.load(std::memory_order_relaxed) + counters.ReallocationCount.load(std::memory_order_relaxed);
+	}
+
+	return count;
+}
+
+HostAllocator::Arena* HostAllocator::GetThreadArena()
+{
+	// One arena per thread and allocator, keyed by id since a new allocator can reuse an address.
+	// Ids are never reused, entries of destroyed allocators are simply never looked up again.
+	thread_local uint64_t t_LastAllocatorId = 0;
+	thread_local Arena* t_LastArena = nullptr;
+	thread_local std::unordered_map<uint64_t, Arena*> t_Arenas;
+
+	if (t_LastAllocatorId == m_Id)
+		return t_LastArena;
+
+	Arena*& arena = t_Arenas[m_Id];
+
+	if (!arena)
+	{
+		arena = new Arena();
+		arena->Memory = static_cast<uint8_t*>(::operator new(HOST_ARENA_SIZE, std::align_val_t(64)));
+
+		std::lock_guard<std::mutex> lock(m_ArenaMutex);
+		m_Arenas.push_back(arena);
+	}
+
+	t_LastAllocatorId = m_Id;
+	t_LastArena = arena;
+
+	return arena;
+}
+
+void* HostAllocator::AllocateTracked(size_t size, size_t alignment, uint32_t scope)
+{
+	alignment = std::max(alignment, alignof(AllocationHeader));
+
+	uint8_t* memory = nullptr;
+	Arena* arena = nullptr;
+
+	// Command scope, bump allocate from the thread's arena
+	if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+	{
+		arena = GetThreadArena();
+
+		if (arena->LiveCount.load(std::memory_order_acquire) == 0)
+			arena->Offset = 0;
+
+		size_t begin = reinterpret_cast<size_t>(arena->Memory);
+		size_t address = AlignUp(begin + arena->Offset + sizeof(AllocationHeader), alignment);
+
+		if (address + size <= begin + HOST_ARENA_SIZE)
+		{
+			memory = reinterpret_cast<uint8_t*>(address);
+			arena->Offset = address + size - begin;
+			arena->LiveCount.fetch_add(1, std::memory_order_relaxed);
+
+			m_ArenaAllocationCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		else
+		{
+			arena = nullptr;
+
+			m_ArenaFallbackCount.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	if (!memory)
+	{
+		size_t offset = AlignUp(sizeof(AllocationHeader), alignment);
+		uint8_t* base = static_cast<uint8_t*>(::operator new(offset + size, std::align_val_t(alignment), std::nothrow));
+
+		if (!base)
+			return nullptr;
+
+		memory = base + offset;
+	}
+
+	AllocationHeader* header = GetHeader(memory);
+	header->Size = size;
+	header->Alignment = static_cast<uint32_t>(alignment);
+	header->Scope = scope;
+	header->Arena = arena;
+
+	ScopeCounters& counters = m_Scopes[scope];
+	counters.AllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+	uint64_t current = counters.CurrentBytes.fetch_add(size, std::memory_order_relaxed) + size;
+	uint64_t peak = counters.PeakBytes.load(std::memory_order_relaxed);
+
+	while (current > peak && !counters.PeakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed))
+	{
+	}
+
+	return memory;
+}
+
+void HostAllocator::FreeTracked(void* memory)
+{
+	AllocationHeader* header = GetHeader(memory);
+
+	m_Scopes[header->Scope].CurrentBytes.fetch_sub(header->Size, std::memory_order_relaxed);
+
+	if (header->Arena)
+	{
+		static_cast<Arena*>(header->Arena)->LiveCount.fetch_sub(1, std::memory_order_release);
+		return;
+	}
+
+	size_t offset = AlignUp(sizeof(AllocationHeader), header->Alignment);
+	::operator delete(static_cast<uint8_t*>(memory) - offset, std::align_val_t(header->Alignment));
+}
+
+void* VKAPI_PTR HostAllocator::Allocate(void* user_data, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	HostAllocator* allocator = static_cast<HostAllocator*>(user_data);
+	uint32_t scope_index = GetScopeIndex(scope);
+
+	if (size == 0)
+		return nullptr;
+
+	allocator->m_Scopes[scope_index].AllocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	return allocator->AllocateTracked(size, alignment, scope_index);
+}
+
+void* VKAPI_PTR HostAllocator::Reallocate(void* user_data, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+{
+	HostAllocator* allocator = static_cast<HostAllocator*>(user_data);
+
+	if (!original)
+		return Allocate(user_data, size, alignment, scope);
+
+	if (size == 0)
+	{
+		Free(user_data, original);
+		return nullptr;
+	}
+
+	uint32_t scope_index = GetScopeIndex(scope);
+	allocator->m_Scopes[scope_index].ReallocationCount.fetch_add(1, std::memory_order_relaxed);
+
+	// The original stays valid when this fails
+	void* memory = allocator->AllocateTracked(size, alignment, scope_index);
+
+	if (!memory)
+		return nullptr;
+
+	std::memcpy(memory, original, std::min<size_t>(size, GetHeader(original)->Size));
+	allocator->FreeTracked(original);
+
+	return memory;
+}
+
+void VKAPI_PTR HostAllocator::Free(void* user_data, void* memory)
+{
+	HostAllocator* allocator = static_cast<HostAllocator*>(user_data);
+
+	if (!memory)
+		return;
+
+	allocator->m_Scopes[GetHeader(memory)->Scope].FreeCount.fetch_add(1, std::memory_order_relaxed);
+	allocator->FreeTracked(memory);
+}
+
+void VKAPI_PTR HostAllocator::InternalAllocation(void* user_data, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope)
+{
+	ScopeCounters& counters = static_cast<HostAllocator*>(user_data)->m_Scopes[GetScopeIndex(scope)];
+
+	counters.InternalAllocationCount.fetch_add(1, std::memory_order_relaxed);
+	counters.InternalBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void VKAPI_PTR HostAllocator::InternalFree(void* user_data, size_t size, VkInternalAllocationType /*type*/, VkSystemAllocationScope scope)
+{
+	ScopeCounters& counters = static_cast<HostAllocator*>(user_data)->m_Scopes[GetScopeIndex(scope)];
+
+	counters.InternalBytes.fetch_sub(size, std::memory_order_relaxed);
+}
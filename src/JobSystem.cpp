@@ -0,0 +1,122 @@
+#include "JobSystem.h"
+#include "Tracer.h"
+
+JobSystem::JobSystem(uint32_t worker_count)
+{
+	if (worker_count == 0)
+	{
+		uint32_t hardware_threads = std::thread::hardware_concurrency();
+		worker_count = hardware_threads > 1 ? hardware_threads - 1 : 0;
+	}
+
+	m_Workers.reserve(worker_count);
+
+	for (uint32_t i = 0; i < worker_count; i++)
+	{
+		m_Workers.emplace_back(&JobSystem::WorkerLoop, this);
+	}
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+
+	m_WakeCondition.notify_all();
+
+	for (std::thread& worker : m_Workers)
+	{
+		worker.join();
+	}
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t batch_size, const std::function<void(uint32_t, uint32_t)>& function)
+{
+	if (count == 0)
+		return;
+
+	if (batch_size == 0)
+		batch_size = 1;
+
+	// Not worth waking anyone up
+	if (m_Workers.empty() || count <= batch_size)
+	{
+		function(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Function = &function;
+		m_Count = count;
+		m_BatchSize = batch_size;
+		m_NextBatch.store(0);
+		m_Generation++;
+	}
+
+	m_WakeCondition.notify_all();
+
+	// The calling thread helps out instead of idling
+	RunBatches(function, count, batch_size);
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_DoneCondition.wait(lock, [this]() { return m_ActiveWorkers == 0; });
+	m_Function = nullptr;
+}
+
+void JobSystem::WorkerLoop()
+{
+	uint32_t generation = 0;
+
+	while (true)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_WakeCondition.wait(lock, [&]() { return m_Quit || m_Generation != generation; });
+
+		if (m_Quit)
+			return;
+
+		generation = m_Generation;
+
+		// Woke up after the job was already finished
+		if (m_Function == nullptr)
+			continue;
+
+		const std::function<void(uint32_t, uint32_t)>& function = *m_Function;
+		uint32_t count = m_Count;
+		uint32_t batch_size = m_BatchSize;
+
+		m_ActiveWorkers++;
+		lock.unlock();
+
+		RunBatches(function, count, batch_size);
+
+		lock.lock();
+		if (--m_ActiveWorkers == 0)
+		{
+			m_DoneCondition.notify_all();
+		}
+	}
+}
+
+void JobSystem::RunBatches(const std::function<void(uint32_t, uint32_t)>& function, uint32_t count, uint32_t batch_size)
+{
+	TRACE_SCOPE("Job Batches");
+
+	const uint32_t batch_count = (count + batch_size - 1) / batch_size;
+
+	while (true)
+	{
+		uint32_t batch = m_NextBatch.fetch_add(1);
+
+		if (batch >= batch_count)
+			return;
+
+		uint32_t begin = batch * batch_size;
+		uint32_t end = begin + batch_size < count ? begin + batch_size : count;
+
+		function(begin, end);
+	}
+}
@@ -0,0 +1,149 @@
+#include <stdexcept>
+#include <utility>
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	Open(filename);
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+
+		std::swap(m_Data, other.m_Data);
+		std::swap(m_Size, other.m_Size);
+#ifdef _WIN32
+		std::swap(m_FileHandle, other.m_FileHandle);
+		std::swap(m_MappingHandle, other.m_MappingHandle);
+#endif
+	}
+
+	return *this;
+}
+
+#ifdef _WIN32
+
+void MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Failed to open file.");
+
+	LARGE_INTEGER size;
+
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map empty file.");
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+	if (mapping == nullptr)
+	{
+		CloseHandle(file);
+		throw std::runtime_error("Failed to create file mapping.");
+	}
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (data == nullptr)
+	{
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map file.");
+	}
+
+	m_FileHandle = file;
+	m_MappingHandle = mapping;
+	m_Data = static_cast<const uint8_t*>(data);
+	m_Size = static_cast<size_t>(size.QuadPart);
+}
+
+void MappedFile::Close()
+{
+	if (m_Data)
+		UnmapViewOfFile(m_Data);
+
+	if (m_MappingHandle)
+		CloseHandle(m_MappingHandle);
+
+	if (m_FileHandle)
+		CloseHandle(m_FileHandle);
+
+	m_Data = nullptr;
+	m_Size = 0;
+	m_FileHandle = nullptr;
+	m_MappingHandle = nullptr;
+}
+
+#else
+
+void MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	int file = open(filename.c_str(), O_RDONLY);
+
+	if (file < 0)
+		throw std::runtime_error("Failed to open file.");
+
+	struct stat file_stat;
+
+	if (fstat(file, &file_stat) != 0 || file_stat.st_size == 0)
+	{
+		close(file);
+		throw std::runtime_error("Failed to map empty file.");
+	}
+
+	void* data = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+
+	// The mapping keeps the file alive
+	close(file);
+
+	if (data == MAP_FAILED)
+		throw std::runtime_error("Failed to map file.");
+
+	m_Data = static_cast<const uint8_t*>(data);
+	m_Size = static_cast<size_t>(file_stat.st_size);
+}
+
+void MappedFile::Close()
+{
+	if (m_Data)
+		munmap(const_cast<uint8_t*>(m_Data), m_Size);
+
+	m_Data = nullptr;
+	m_Size = 0;
+}
+
+#endif
@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include "MemoryBudget.h"
+
+void MemoryBudget::Init(VkPhysicalDevice physical_device, PFN_vkGetPhysicalDeviceMemoryProperties2KHR get_memory_properties2)
+{
+	m_PhysicalDevice = physical_device;
+	m_GetMemoryProperties2 = get_memory_properties2;
+
+	vkGetPhysicalDeviceMemoryProperties(m_PhysicalDevice, &m_MemoryProperties);
+
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryHeapCount; i++)
+	{
+		m_Heaps[i].Size = m_MemoryProperties.memoryHeaps[i].size;
+		m_Heaps[i].DeviceLocal = (m_MemoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+
+	Update();
+}
+
+void MemoryBudget::Update()
+{
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+	budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	if (m_GetMemoryProperties2)
+	{
+		VkPhysicalDeviceMemoryProperties2KHR properties = {};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+		properties.pNext = &budget;
+
+		m_GetMemoryProperties2(m_PhysicalDevice, &properties);
+	}
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	for (uint32_t i = 0; i < m_MemoryProperties.memoryHeapCount; i++)
+	{
+		MemoryHeapBudget& heap = m_Heaps[i];
+
+		if (m_GetMemoryProperties2)
+		{
+			heap.Budget = budget.heapBudget[i];
+			heap.Usage = budget.heapUsage[i];
+		}
+		else
+		{
+			heap.Budget = static_cast<VkDeviceSize>(heap.Size * MEMORY_BUDGET_FALLBACK_FRACTION);
+			heap.Usage = heap.TrackedUsage;
+		}
+
+		heap.PeakUsage = std::max(heap.PeakUsage, heap.Usage);
+	}
+}
+
+void MemoryBudget::TrackAllocation(VkDeviceMemory memory, uint32_t memory_type, VkDeviceSize size)
+{
+	uint32_t heap = m_MemoryProperties.memoryTypes[memory_type].heapIndex;
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Allocations[memory] = { heap, size };
+	m_Heaps[heap].TrackedUsage += size;
+}
+
+void MemoryBudget::TrackFree(VkDeviceMemory memory)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	auto allocation = m_Allocations.find(memory);
+
+	if (allocation == m_Allocations.end())
+		return;
+
+	m_Heaps[allocation->second.Heap].TrackedUsage -= allocation->second.Size;
+	m_Allocations.erase(allocation);
+}
+
+uint32_t MemoryBudget::GetAllocationHeap(VkDeviceMemory memory) const
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	auto allocation = m_Allocations.find(memory);
+
+	return allocation != m_Allocations.end() ? allocation->second.Heap : UINT32_MAX;
+}
@@ -0,0 +1,175 @@
+#include <algorithm>
+
+#include "ResidencyManager.h"
+#include "MemoryBudget.h"
+
+uint32_t ResidencyManager::Register(uint32_t heap, VkDeviceSize size, uint64_t frame, EvictFunction evict)
+{
+	uint32_t resource = static_cast<uint32_t>(m_Resources.size());
+	m_Resources.emplace_back();
+
+	Resource& entry = m_Resources[resource];
+	entry.Heap = heap;
+	entry.Size = size;
+	entry.LastUsed = frame;
+	entry.Evict = std::move(evict);
+	entry.Resident = true;
+	entry.Registered = true;
+	Link(resource);
+
+	m_Stats.ResourceCount++;
+	m_Stats.ResidentCount++;
+	m_Stats.ResidentBytes += size;
+
+	return resource;
+}
+
+void ResidencyManager::Unregister(uint32_t resource)
+{
+	Resource& entry = m_Resources[resource];
+
+	if (!entry.Registered)
+		return;
+
+	if (entry.Resident)
+	{
+		Unlink(resource);
+		m_Stats.ResidentCount--;
+		m_Stats.ResidentBytes -= entry.Size;
+	}
+
+	entry.Evict = nullptr;
+	entry.Resident = false;
+	entry.Registered = false;
+	m_Stats.ResourceCount--;
+}
+
+void ResidencyManager::Touch(uint32_t resource, uint64_t frame)
+{
+	Resource& entry = m_Resources[resource];
+	entry.LastUsed = frame;
+
+	if (entry.Resident && resource != m_Tail)
+	{
+		Unlink(resource);
+		Link(resource);
+	}
+}
+
+void ResidencyManager::MarkResident(uint32_t resource, uint64_t frame)
+{
+	Resource& entry = m_Resources[resource];
+	entry.LastUsed = frame;
+
+	if (entry.Resident)
+		return;
+
+	entry.Resident = true;
+	Link(resource);
+
+	m_Stats.ResidentCount++;
+	m_Stats.ResidentBytes += entry.Size;
+	m_Stats.RestoreCount++;
+}
+
+void ResidencyManager::Enforce(const MemoryBudget& budget, uint64_t frame, uint64_t completed_frame)
+{
+	// Released memory shows up in the driver reported usage once the deletion queue freed it
+	while (!m_PendingReleases.empty() && m_PendingReleases.front().Frame <= completed_frame)
+	{
+		m_Stats.PendingBytes -= m_PendingReleases.front().Size;
+		m_PendingReleases.pop_front();
+	}
+
+	bool over_budget = false;
+
+	for (uint32_t heap = 0; heap < budget.GetHeapCount(); heap++)
+	{
+		const MemoryHeapBudget& heap_budget = budget.GetHeap(heap);
+		VkDeviceSize target = static_cast<VkDeviceSize>(heap_budget.Budget * m_BudgetFraction);
+
+		if (m_HeapLimits[heap] != 0)
+			target = std::min(target, m_HeapLimits[heap]);
+
+		// Tracked usage already dropped when the resources were released
+		VkDeviceSize usage = heap_budget.Usage;
+
+		if (budget.HasBudgetExtension())
+		{
+			for (const PendingRelease& release : m_PendingReleases)
+			{
+				if (release.Heap == heap)
+					usage -= std::min(usage, release.Size);
+			}
+		}
+
+		uint32_t resource = m_Head;
+
+		while (usage > target && resource != INVALID_RESIDENCY_ID)
+		{
+			Resource& entry = m_Resources[resource];
+			uint32_t next = entry.Next;
+
+			// Everything after it was used at least as recently
+			if (entry.LastUsed >= frame)
+				break;
+
+			if (entry.Heap == heap)
+			{
+				Unlink(resource);
+				entry.Resident = false;
+
+				m_PendingReleases.push_back({ frame, heap, entry.Size });
+				usage -= std::min(usage, entry.Size);
+
+				m_Stats.ResidentCount--;
+				m_Stats.ResidentBytes -= entry.Size;
+				m_Stats.PendingBytes += entry.Size;
+				m_Stats.EvictionCount++;
+				m_Stats.EvictedBytes += entry.Size;
+
+				entry.Evict();
+			}
+
+			resource = next;
+		}
+
+		if (usage > target)
+			over_budget = true;
+	}
+
+	if (over_budget)
+		m_Stats.FramesOverBudget++;
+}
+
+void ResidencyManager::Link(uint32_t resource)
+{
+	Resource& entry = m_Resources[resource];
+	entry.Previous = m_Tail;
+	entry.Next = INVALID_RESIDENCY_ID;
+
+	if (m_Tail != INVALID_RESIDENCY_ID)
+		m_Resources[m_Tail].Next = resource;
+	else
+		m_Head = resource;
+
+	m_Tail = resource;
+}
+
+void ResidencyManager::Unlink(uint32_t resource)
+{
+	Resource& entry = m_Resources[resource];
+
+	if (entry.Previous != INVALID_RESIDENCY_ID)
+		m_Resources[entry.Previous].Next = entry.Next;
+	else
+		m_Head = entry.Next;
+
+	if (entry.Next != INVALID_RESIDENCY_ID)
+		m_Resources[entry.Next].Previous = entry.Previous;
+	else
+		m_Tail = entry.Previous;
+
+	entry.Previous = INVALID_RESIDENCY_ID;
+	entry.Next = INVALID_RESIDENCY_ID;
+}
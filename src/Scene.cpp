@@ -0,0 +1,534 @@
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+#include "Scene.h"
+#include "JobSystem.h"
+
+#if defined(__AVX__)
+#define SCENE_SIMD_AVX
+#define SCENE_SIMD_SSE
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+// Objects per job, large enough to amortize scheduling and keep each job on its own cache lines
+const uint32_t TRANSFORM_BATCH_SIZE = 1024;
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double MillisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+#ifdef SCENE_SIMD_SSE
+
+// Transposes the 3x4 rotation/scale rows plus translation of 4 objects into 4 column major matrices
+static inline void StoreMatricesSSE(
+	__m128 m00, __m128 m01, __m128 m02,
+	__m128 m10, __m128 m11, __m128 m12,
+	__m128 m20, __m128 m21, __m128 m22,
+	__m128 px, __m128 py, __m128 pz,
+	float* world, float* instance)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 c0_0 = m00, c0_1 = m01, c0_2 = m02, c0_3 = zero;
+	__m128 c1_0 = m10, c1_1 = m11, c1_2 = m12, c1_3 = zero;
+	__m128 c2_0 = m20, c2_1 = m21, c2_2 = m22, c2_3 = zero;
+	__m128 c3_0 = px, c3_1 = py, c3_2 = pz, c3_3 = one;
+
+	_MM_TRANSPOSE4_PS(c0_0, c0_1, c0_2, c0_3);
+	_MM_TRANSPOSE4_PS(c1_0, c1_1, c1_2, c1_3);
+	_MM_TRANSPOSE4_PS(c2_0, c2_1, c2_2, c2_3);
+	_MM_TRANSPOSE4_PS(c3_0, c3_1, c3_2, c3_3);
+
+	const __m128 columns[16] = {
+		c0_0, c1_0, c2_0, c3_0,
+		c0_1, c1_1, c2_1, c3_1,
+		c0_2, c1_2, c2_2, c3_2,
+		c0_3, c1_3, c2_3, c3_3,
+	};
+
+	for (int i = 0; i < 16; i++)
+	{
+		_mm_storeu_ps(world + i * 4, columns[i]);
+	}
+
+	// Bypass the cache for the write-combined GPU memory, it is never read back on the CPU
+	if (instance)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			_mm_stream_ps(instance + i * 4, columns[i]);
+		}
+	}
+}
+
+static inline void ComputeLocalMatricesSSE(
+	const float* pos_x, const float* pos_y, const float* pos_z,
+	const float* rot_x, const float* rot_y, const float* rot_z, const float* rot_w,
+	const float* scale_x, const float* scale_y, const float* scale_z,
+	float* world, float* instance)
+{
+	const __m128 one = _mm_set1_ps(1.0f);
+
+	__m128 qx = _mm_loadu_ps(rot_x);
+	__m128 qy = _mm_loadu_ps(rot_y);
+	__m128 qz = _mm_loadu_ps(rot_z);
+	__m128 qw = _mm_loadu_ps(rot_w);
+
+	__m128 qx2 = _mm_add_ps(qx, qx);
+	__m128 qy2 = _mm_add_ps(qy, qy);
+	__m128 qz2 = _mm_add_ps(qz, qz);
+
+	__m128 xx = _mm_mul_ps(qx, qx2);
+	__m128 yy = _mm_mul_ps(qy, qy2);
+	__m128 zz = _mm_mul_ps(qz, qz2);
+	__m128 xy = _mm_mul_ps(qx, qy2);
+	__m128 xz = _mm_mul_ps(qx, qz2);
+	__m128 yz = _mm_mul_ps(qy, qz2);
+	__m128 wx = _mm_mul_ps(qw, qx2);
+	__m128 wy = _mm_mul_ps(qw, qy2);
+	__m128 wz = _mm_mul_ps(qw, qz2);
+
+	__m128 sx = _mm_loadu_ps(scale_x);
+	__m128 sy = _mm_loadu_ps(scale_y);
+	__m128 sz = _mm_loadu_ps(scale_z);
+
+	StoreMatricesSSE(
+		_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx),
+		_mm_mul_ps(_mm_add_ps(xy, wz), sx),
+		_mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+		_mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+		_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy),
+		_mm_mul_ps(_mm_add_ps(yz, wx), sy),
+		_mm_mul_ps(_mm_add_ps(xz, wy), sz),
+		_mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+		_mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz),
+		_mm_loadu_ps(pos_x), _mm_loadu_ps(pos_y), _mm_loadu_ps(pos_z),
+		world, instance);
+}
+
+#endif
+
+#ifdef SCENE_SIMD_AVX
+
+static inline void ComputeLocalMatricesAVX(
+	const float* pos_x, const float* pos_y, const float* pos_z,
+	const float* rot_x, const float* rot_y, const float* rot_z, const float* rot_w,
+	const float* scale_x, const float* scale_y, const float* scale_z,
+	float* world, float* instance)
+{
+	const __m256 one = _mm256_set1_ps(1.0f);
+
+	__m256 qx = _mm256_loadu_ps(rot_x);
+	__m256 qy = _mm256_loadu_ps(rot_y);
+	__m256 qz = _mm256_loadu_ps(rot_z);
+	__m256 qw = _mm256_loadu_ps(rot_w);
+
+	__m256 qx2 = _mm256_add_ps(qx, qx);
+	__m256 qy2 = _mm256_add_ps(qy, qy);
+	__m256 qz2 = _mm256_add_ps(qz, qz);
+
+	__m256 xx = _mm256_mul_ps(qx, qx2);
+	__m256 yy = _mm256_mul_ps(qy, qy2);
+	__m256 zz = _mm256_mul_ps(qz, qz2);
+	__m256 xy = _mm256_mul_ps(qx, qy2);
+	__m256 xz = _mm256_mul_ps(qx, qz2);
+	__m256 yz = _mm256_mul_ps(qy, qz2);
+	__m256 wx = _mm256_mul_ps(qw, qx2);
+	__m256 wy = _mm256_mul_ps(qw, qy2);
+	__m256 wz = _mm256_mul_ps(qw, qz2);
+
+	__m256 sx = _mm256_loadu_ps(scale_x);
+	__m256 sy = _mm256_loadu_ps(scale_y);
+	__m256 sz = _mm256_loadu_ps(scale_z);
+
+	__m256 m[12] = {
+		_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx),
+		_mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+		_mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+		_mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+		_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy),
+		_mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+		_mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+		_mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+		_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz),
+		_mm256_loadu_ps(pos_x),
+		_mm256_loadu_ps(pos_y),
+		_mm256_loadu_ps(pos_z),
+	};
+
+	// The transpose is done per 128 bit half, 4 objects at a time
+	__m128 lo[12];
+	__m128 hi[12];
+
+	for (int i = 0; i < 12; i++)
+	{
+		lo[i] = _mm256_castps256_ps128(m[i]);
+		hi[i] = _mm256_extractf128_ps(m[i], 1);
+	}
+
+	StoreMatricesSSE(lo[0], lo[1], lo[2], lo[3], lo[4], lo[5], lo[6], lo[7], lo[8], lo[9], lo[10], lo[11], world, instance);
+	StoreMatricesSSE(hi[0], hi[1], hi[2], hi[3], hi[4], hi[5], hi[6], hi[7], hi[8], hi[9], hi[10], hi[11], world + 64, instance ? instance + 64 : nullptr);
+}
+
+#endif
+
+static inline void ComputeLocalMatrixScalar(
+	float px, float py, float pz,
+	float qx, float qy, float qz, float qw,
+	float sx, float sy, float sz,
+	float* world, float* instance)
+{
+	float xx = qx * (qx + qx), yy = qy * (qy + qy), zz = qz * (qz + qz);
+	float xy = qx * (qy + qy), xz = qx * (qz + qz), yz = qy * (qz + qz);
+	float wx = qw * (qx + qx), wy = qw * (qy + qy), wz = qw * (qz + qz);
+
+	float matrix[16] = {
+		(1.0f - (yy + zz)) * sx, (xy + wz) * sx, (xz - wy) * sx, 0.0f,
+		(xy - wz) * sy, (1.0f - (xx + zz)) * sy, (yz + wx) * sy, 0.0f,
+		(xz + wy) * sz, (yz - wx) * sz, (1.0f - (xx + yy)) * sz, 0.0f,
+		px, py, pz, 1.0f,
+	};
+
+	for (int i = 0; i < 16; i++)
+	{
+		world[i] = matrix[i];
+	}
+
+	if (instance)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			instance[i] = matrix[i];
+		}
+	}
+}
+
+// result = parent * local, all column major. result may alias local.
+static inline void MultiplyMatrices(const float* parent, const float* local, float* result)
+{
+#ifdef SCENE_SIMD_SSE
+	__m128 p0 = _mm_loadu_ps(parent + 0);
+	__m128 p1 = _mm_loadu_ps(parent + 4);
+	__m128 p2 = _mm_loadu_ps(parent + 8);
+	__m128 p3 = _mm_loadu_ps(parent + 12);
+
+	__m128 columns[4];
+
+	for (int i = 0; i < 4; i++)
+	{
+		const float* l = local + i * 4;
+
+		columns[i] = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(l[0])), _mm_mul_ps(p1, _mm_set1_ps(l[1]))),
+			_mm_add_ps(_mm_mul_ps(p2, _mm_set1_ps(l[2])), _mm_mul_ps(p3, _mm_set1_ps(l[3]))));
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		_mm_storeu_ps(result + i * 4, columns[i]);
+	}
+#else
+	float columns[16];
+
+	for (int i = 0; i < 4; i++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			columns[i * 4 + row] =
+				parent[0 * 4 + row] * local[i * 4 + 0] +
+				parent[1 * 4 + row] * local[i * 4 + 1] +
+				parent[2 * 4 + row] * local[i * 4 + 2] +
+				parent[3 * 4 + row] * local[i * 4 + 3];
+		}
+	}
+
+	for (int i = 0; i < 16; i++)
+	{
+		result[i] = columns[i];
+	}
+#endif
+}
+
+uint32_t Scene::CreateObject(const SceneObjectDesc& desc)
+{
+	uint32_t object = GetObjectCount();
+
+	if (desc.Parent != INVALID_SCENE_OBJECT && desc.Parent >= object)
+		throw std::runtime_error("Scene object parent has to be created before its children.");
+
+	m_PositionX.push_back(desc.Position[0]);
+	m_PositionY.push_back(desc.Position[1]);
+	m_PositionZ.push_back(desc.Position[2]);
+
+	m_RotationX.push_back(desc.Rotation[0]);
+	m_RotationY.push_back(desc.Rotation[1]);
+	m_RotationZ.push_back(desc.Rotation[2]);
+	m_RotationW.push_back(desc.Rotation[3]);
+
+	m_ScaleX.push_back(desc.Scale[0]);
+	m_ScaleY.push_back(desc.Scale[1]);
+	m_ScaleZ.push_back(desc.Scale[2]);
+
+	m_LocalCenterX.push_back(desc.BoundsCenter[0]);
+	m_LocalCenterY.push_back(desc.BoundsCenter[1]);
+	m_LocalCenterZ.push_back(desc.BoundsCenter[2]);
+	m_LocalExtentX.push_back(desc.BoundsExtents[0]);
+	m_LocalExtentY.push_back(desc.BoundsExtents[1]);
+	m_LocalExtentZ.push_back(desc.BoundsExtents[2]);
+
+	m_WorldCenterX.push_back(0.0f);
+	m_WorldCenterY.push_back(0.0f);
+	m_WorldCenterZ.push_back(0.0f);
+	m_WorldExtentX.push_back(0.0f);
+	m_WorldExtentY.push_back(0.0f);
+	m_WorldExtentZ.push_back(0.0f);
+
+	m_Parents.push_back(desc.Parent);
+	m_Depths.push_back(desc.Parent == INVALID_SCENE_OBJECT ? 0 : m_Depths[desc.Parent] + 1);
+
+	m_WorldMatrices.resize(m_WorldMatrices.size() + 16);
+
+	if (desc.Parent != INVALID_SCENE_OBJECT)
+		m_HierarchyDirty = true;
+
+	return object;
+}
+
+void Scene::Clear()
+{
+	*this = Scene();
+}
+
+void Scene::Reserve(uint32_t capacity)
+{
+	std::vector<float>* pools[] = {
+		&m_PositionX, &m_PositionY, &m_PositionZ,
+		&m_RotationX, &m_RotationY, &m_RotationZ, &m_RotationW,
+		&m_ScaleX, &m_ScaleY, &m_ScaleZ,
+		&m_LocalCenterX, &m_LocalCenterY, &m_LocalCenterZ,
+		&m_LocalExtentX, &m_LocalExtentY, &m_LocalExtentZ,
+		&m_WorldCenterX, &m_WorldCenterY, &m_WorldCenterZ,
+		&m_WorldExtentX, &m_WorldExtentY, &m_WorldExtentZ,
+	};
+
+	for (std::vector<float>* pool : pools)
+	{
+		pool->reserve(capacity);
+	}
+
+	m_Parents.reserve(capacity);
+	m_Depths.reserve(capacity);
+	m_WorldMatrices.reserve(static_cast<size_t>(capacity) * 16);
+}
+
+void Scene::SetPosition(uint32_t object, float x, float y, float z)
+{
+	m_PositionX[object] = x;
+	m_PositionY[object] = y;
+	m_PositionZ[object] = z;
+}
+
+void Scene::SetRotation(uint32_t object, float x, float y, float z, float w)
+{
+	m_RotationX[object] = x;
+	m_RotationY[object] = y;
+	m_RotationZ[object] = z;
+	m_RotationW[object] = w;
+}
+
+void Scene::SetScale(uint32_t object, float x, float y, float z)
+{
+	m_ScaleX[object] = x;
+	m_ScaleY[object] = y;
+	m_ScaleZ[object] = z;
+}
+
+void Scene::RebuildHierarchyLevels()
+{
+	// Counting sort of all child objects by depth, roots are handled by the local pass
+	uint32_t max_depth = 0;
+
+	for (uint32_t depth : m_Depths)
+	{
+		max_depth = depth > max_depth ? depth : max_depth;
+	}
+
+	m_LevelOffsets.assign(max_depth + 2, 0);
+
+	for (uint32_t depth : m_Depths)
+	{
+		if (depth > 0)
+			m_LevelOffsets[depth + 1]++;
+	}
+
+	for (size_t i = 1; i < m_LevelOffsets.size(); i++)
+	{
+		m_LevelOffsets[i] += m_LevelOffsets[i - 1];
+	}
+
+	m_HierarchyOrder.resize(m_LevelOffsets.back());
+
+	std::vector<uint32_t> cursor = m_LevelOffsets;
+
+	for (uint32_t i = 0; i < GetObjectCount(); i++)
+	{
+		if (m_Depths[i] > 0)
+			m_HierarchyOrder[cursor[m_Depths[i]]++] = i;
+	}
+
+	m_HierarchyDirty = false;
+}
+
+void Scene::ComputeLocalMatrices(uint32_t begin, uint32_t end, float* instance_data)
+{
+	uint32_t i = begin;
+
+#ifdef SCENE_SIMD_AVX
+	for (; i + 8 <= end; i += 8)
+	{
+		ComputeLocalMatricesAVX(
+			&m_PositionX[i], &m_PositionY[i], &m_PositionZ[i],
+			&m_RotationX[i], &m_RotationY[i], &m_RotationZ[i], &m_RotationW[i],
+			&m_ScaleX[i], &m_ScaleY[i], &m_ScaleZ[i],
+			&m_WorldMatrices[i * 16], instance_data ? instance_data + i * 16 : nullptr);
+	}
+#endif
+
+#ifdef SCENE_SIMD_SSE
+	for (; i + 4 <= end; i += 4)
+	{
+		ComputeLocalMatricesSSE(
+			&m_PositionX[i], &m_PositionY[i], &m_PositionZ[i],
+			&m_RotationX[i], &m_RotationY[i], &m_RotationZ[i], &m_RotationW[i],
+			&m_ScaleX[i], &m_ScaleY[i], &m_ScaleZ[i],
+			&m_WorldMatrices[i * 16], instance_data ? instance_data + i * 16 : nullptr);
+	}
+
+	// Make the streamed stores visible before the GPU or another thread reads them
+	_mm_sfence();
+#endif
+
+	for (; i < end; i++)
+	{
+		ComputeLocalMatrixScalar(
+			m_PositionX[i], m_PositionY[i], m_PositionZ[i],
+			m_RotationX[i], m_RotationY[i], m_RotationZ[i], m_RotationW[i],
+			m_ScaleX[i], m_ScaleY[i], m_ScaleZ[i],
+			&m_WorldMatrices[i * 16], instance_data ? instance_data + i * 16 : nullptr);
+	}
+}
+
+void Scene::ComputeWorldMatrices(const uint32_t* objects, uint32_t count, float* instance_data)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t object = objects[i];
+		float* world = &m_WorldMatrices[object * 16];
+
+		// The local pass left the local matrix in place
+		MultiplyMatrices(&m_WorldMatrices[m_Parents[object] * 16], world, world);
+
+		if (instance_data)
+		{
+			float* instance = instance_data + object * 16;
+
+			for (int j = 0; j < 16; j++)
+			{
+				instance[j] = world[j];
+			}
+		}
+	}
+}
+
+void Scene::ComputeWorldBounds(uint32_t begin, uint32_t end, float* bounds_data)
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const float* m = &m_WorldMatrices[i * 16];
+
+		float cx = m_LocalCenterX[i], cy = m_LocalCenterY[i], cz = m_LocalCenterZ[i];
+		float ex = m_LocalExtentX[i], ey = m_LocalExtentY[i], ez = m_LocalExtentZ[i];
+
+		m_WorldCenterX[i] = m[0] * cx + m[4] * cy + m[8] * cz + m[12];
+		m_WorldCenterY[i] = m[1] * cx + m[5] * cy + m[9] * cz + m[13];
+		m_WorldCenterZ[i] = m[2] * cx + m[6] * cy + m[10] * cz + m[14];
+
+		m_WorldExtentX[i] = std::fabs(m[0]) * ex + std::fabs(m[4]) * ey + std::fabs(m[8]) * ez;
+		m_WorldExtentY[i] = std::fabs(m[1]) * ex + std::fabs(m[5]) * ey + std::fabs(m[9]) * ez;
+		m_WorldExtentZ[i] = std::fabs(m[2]) * ex + std::fabs(m[6]) * ey + std::fabs(m[10]) * ez;
+
+		if (bounds_data)
+		{
+			float* bounds = bounds_data + i * 8;
+
+			bounds[0] = m_WorldCenterX[i];
+			bounds[1] = m_WorldCenterY[i];
+			bounds[2] = m_WorldCenterZ[i];
+			bounds[3] = 0.0f;
+			bounds[4] = m_WorldExtentX[i];
+			bounds[5] = m_WorldExtentY[i];
+			bounds[6] = m_WorldExtentZ[i];
+			bounds[7] = 0.0f;
+		}
+	}
+}
+
+void Scene::UpdateTransforms(JobSystem& job_system, void* instance_data, void* bounds_data)
+{
+	const uint32_t count = GetObjectCount();
+	float* instance = static_cast<float*>(instance_data);
+
+	if (m_HierarchyDirty)
+		RebuildHierarchyLevels();
+
+	auto start = Clock::now();
+
+	// Local matrices (equal to world matrices for roots)
+	job_system.ParallelFor(count, TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+	{
+		ComputeLocalMatrices(begin, end, instance);
+	});
+
+	auto hierarchy_start = Clock::now();
+	m_Stats.LocalMs = MillisecondsSince(start);
+
+	// Children, one level at a time
+	for (size_t level = 1; level + 1 < m_LevelOffsets.size(); level++)
+	{
+		const uint32_t* objects = m_HierarchyOrder.data() + m_LevelOffsets[level];
+		uint32_t level_count = m_LevelOffsets[level + 1] - m_LevelOffsets[level];
+
+		job_system.ParallelFor(level_count, TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+		{
+			ComputeWorldMatrices(objects + begin, end - begin, instance);
+		});
+	}
+
+	auto bounds_start = Clock::now();
+	m_Stats.HierarchyMs = MillisecondsSince(hierarchy_start);
+
+	job_system.ParallelFor(count, TRANSFORM_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+	{
+		ComputeWorldBounds(begin, end, static_cast<float*>(bounds_data));
+	});
+
+	m_Stats.BoundsMs = MillisecondsSince(bounds_start);
+	m_Stats.TotalMs = MillisecondsSince(start);
+	m_Stats.ObjectCount = count;
+	m_Stats.ThreadCount = job_system.GetThreadCount();
+
+	m_Stats.UpdateCount++;
+	m_Stats.AccumulatedSeconds += m_Stats.TotalMs / 1000.0;
+	m_Stats.AccumulatedObjects += count;
+
+	if (m_Stats.AccumulatedSeconds > 0.0)
+		m_Stats.ObjectsPerSecondPerCore = m_Stats.AccumulatedObjects / m_Stats.AccumulatedSeconds / m_Stats.ThreadCount;
+}
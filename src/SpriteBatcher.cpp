@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <chrono>
+
+#include "SpriteBatcher.h"
+#include "JobSystem.h"
+
+// Quads per vertex writing job
+const uint32_t SPRITE_WRITE_BATCH_SIZE = 4096;
+
+// Sort key layout, layer in bits 40-55, blend state in bits 32-39 and texture in bits 0-31.
+// Radix sorted in bytes, a quad's batch state is everything below the layer.
+const uint32_t SPRITE_KEY_DIGITS = 7;
+const uint64_t SPRITE_BATCH_STATE_MASK = 0xFFFFFFFFFFull;
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double MillisecondsSince(Clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static uint64_t MakeSortKey(const SpriteQuad& quad)
+{
+	return (static_cast<uint64_t>(quad.Layer) << 40) | (static_cast<uint64_t>(quad.Blend) << 32) | quad.Texture;
+}
+
+void SpriteBatcher::Reserve(uint32_t capacity)
+{
+	m_Quads.reserve(capacity);
+	m_Keys.reserve(capacity);
+	m_KeysTemp.reserve(capacity);
+	m_Order.reserve(capacity);
+	m_OrderTemp.reserve(capacity);
+}
+
+void SpriteBatcher::Build(JobSystem& job_system, SpriteVertex* vertices, uint32_t max_quads)
+{
+	auto start = Clock::now();
+
+	uint32_t quad_count = std::min(static_cast<uint32_t>(m_Quads.size()), max_quads);
+
+	m_Batches.clear();
+	m_Stats.QuadCount = quad_count;
+	m_Stats.DroppedCount = static_cast<uint32_t>(m_Quads.size()) - quad_count;
+	m_Stats.SortPasses = 0;
+	m_Stats.SortMs = 0.0;
+	m_Stats.WriteMs = 0.0;
+
+	if (quad_count > 0)
+	{
+		// Stable, quads with the same key stay in submission order
+		SortQuads(quad_count);
+
+		for (uint32_t i = 0; i < quad_count; i++)
+		{
+			uint64_t state = m_Keys[i] & SPRITE_BATCH_STATE_MASK;
+
+			if (m_Batches.empty() || state != (m_Keys[i - 1] & SPRITE_BATCH_STATE_MASK))
+			{
+				SpriteBatch batch;
+				batch.Texture = static_cast<uint32_t>(state);
+				batch.Blend = static_cast<SpriteBlend>(state >> 32);
+				batch.FirstQuad = i;
+
+				m_Batches.push_back(batch);
+			}
+
+			m_Batches.back().QuadCount++;
+		}
+
+		m_Stats.SortMs = MillisecondsSince(start);
+
+		auto write_start = Clock::now();
+
+		job_system.ParallelFor(quad_count, SPRITE_WRITE_BATCH_SIZE, [&](uint32_t begin, uint32_t end)
+		{
+			WriteVertices(begin, end, vertices);
+		});
+
+		m_Stats.WriteMs = MillisecondsSince(write_start);
+	}
+
+	m_Quads.clear();
+
+	m_Stats.BatchCount = static_cast<uint32_t>(m_Batches.size());
+	m_Stats.TotalMs = MillisecondsSince(start);
+	m_Stats.BuildCount++;
+	m_Stats.AccumulatedQuads += quad_count;
+	m_Stats.AccumulatedMs += m_Stats.TotalMs;
+}
+
+void SpriteBatcher::SortQuads(uint32_t quad_count)
+{
+	m_Keys.resize(quad_count);
+	m_KeysTemp.resize(quad_count);
+	m_Order.resize(quad_count);
+	m_OrderTemp.resize(quad_count);
+
+	// All digit histograms in one pass, they don't change when the keys get reordered
+	uint32_t histograms[SPRITE_KEY_DIGITS][256] = {};
+
+	for (uint32_t i = 0; i < quad_count; i++)
+	{
+		uint64_t key = MakeSortKey(m_Quads[i]);
+
+		m_Keys[i] = key;
+		m_Order[i] = i;
+
+		for (uint32_t digit = 0; digit < SPRITE_KEY_DIGITS; digit++)
+		{
+			histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+		}
+	}
+
+	// Least significant digit first, each pass is stable
+	for (uint32_t digit = 0; digit < SPRITE_KEY_DIGITS; digit++)
+	{
+		const uint32_t shift = digit * 8;
+		uint32_t* histogram = histograms[digit];
+
+		// Every key has the same digit, typical for layers and the upper texture bytes
+		if (histogram[(m_Keys[0] >> shift) & 0xFF] == quad_count)
+			continue;
+
+		uint32_t offset = 0;
+
+		for (uint32_t bucket = 0; bucket < 256; bucket++)
+		{
+			uint32_t count = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += count;
+		}
+
+		for (uint32_t i = 0; i < quad_count; i++)
+		{
+			uint32_t destination = histogram[(m_Keys[i] >> shift) & 0xFF]++;
+
+			m_KeysTemp[destination] = m_Keys[i];
+			m_OrderTemp[destination] = m_Order[i];
+		}
+
+		m_Keys.swap(m_KeysTemp);
+		m_Order.swap(m_OrderTemp);
+		m_Stats.SortPasses++;
+	}
+}
+
+void SpriteBatcher::WriteVertices(uint32_t begin, uint32_t end, SpriteVertex* vertices) const
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const SpriteQuad& quad = m_Quads[m_Order[i]];
+
+		const float x0 = quad.Position[0];
+		const float y0 = quad.Position[1];
+		const float x1 = x0 + quad.Size[0];
+		const float y1 = y0 + quad.Size[1];
+		const float* uv = quad.TexCoords;
+
+		// Whole vertices in order, never read back from the mapped memory
+		SpriteVertex* quad_vertices = vertices + static_cast<size_t>(i) * SPRITE_VERTICES_PER_QUAD;
+		quad_vertices[0] = { { x0, y0 }, { uv[0], uv[1] }, quad.Color };
+		quad_vertices[1] = { { x1, y0 }, { uv[2], uv[1] }, quad.Color };
+		quad_vertices[2] = { { x1, y1 }, { uv[2], uv[3] }, quad.Color };
+		quad_vertices[3] = { { x0, y1 }, { uv[0], uv[3] }, quad.Color };
+	}
+}
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "TaskGraph.h"
+#include "JobSystem.h"
+#include "Tracer.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+uint32_t TaskGraph::AddTask(const char* name, std::function<void()> function, const std::vector<uint32_t>& dependencies, TaskThread thread)
+{
+	uint32_t task = static_cast<uint32_t>(m_Tasks.size());
+
+	for (uint32_t dependency : dependencies)
+	{
+		if (dependency >= task)
+			throw std::runtime_error("Task graph dependency has to be added before the task.");
+
+		m_Tasks[dependency].Dependents.push_back(task);
+	}
+
+	Task& entry = m_Tasks.emplace_back();
+	entry.Name = name;
+	entry.Function = std::move(function);
+	entry.DependencyCount = static_cast<uint32_t>(dependencies.size());
+	entry.Thread = thread;
+
+	return task;
+}
+
+void TaskGraph::Run(JobSystem& job_system)
+{
+	TRACE_SCOPE("Task Graph");
+
+	m_MainThread = std::this_thread::get_id();
+	m_Start = Clock::now();
+	m_FinishedCount = 0;
+	m_RunningCount = 0;
+	m_Error = nullptr;
+
+	for (uint32_t i = 0; i < m_Tasks.size(); i++)
+	{
+		Task& task = m_Tasks[i];
+		task.PendingDependencies = task.DependencyCount;
+		task.CriticalPathMs = 0.0;
+
+		if (task.PendingDependencies == 0)
+			(task.Thread == TaskThread::Main ? m_ReadyMainTasks : m_ReadyTasks).push_back(i);
+	}
+
+	// One batch per thread, each runs tasks until the graph is done. A worker holds on to its
+	// batch until then, so the calling thread always gets one for the main thread tasks.
+	const uint32_t thread_count = job_system.GetThreadCount();
+
+	job_system.ParallelFor(thread_count, 1, [this](uint32_t, uint32_t)
+	{
+		RunTasks();
+	});
+
+	m_ReadyTasks.clear();
+	m_ReadyMainTasks.clear();
+
+	// Dependencies come first, one pass in order finds the longest chain
+	m_Stats = TaskGraphStats();
+	m_Stats.TaskCount = static_cast<uint32_t>(m_Tasks.size());
+	m_Stats.ThreadCount = thread_count;
+	m_Stats.WallMs = std::chrono::duration<double, std::milli>(Clock::now() - m_Start).count();
+
+	for (Task& task : m_Tasks)
+	{
+		double duration = task.EndMs - task.StartMs;
+
+		task.CriticalPathMs += duration;
+		m_Stats.TaskMs += duration;
+		m_Stats.CriticalPathMs = std::max(m_Stats.CriticalPathMs, task.CriticalPathMs);
+
+		for (uint32_t dependent : task.Dependents)
+		{
+			m_Tasks[dependent].CriticalPathMs = std::max(m_Tasks[dependent].CriticalPathMs, task.CriticalPathMs);
+		}
+	}
+
+	if (m_Error)
+		std::rethrow_exception(m_Error);
+}
+
+void TaskGraph::RunTasks()
+{
+	const bool main_thread = std::this_thread::get_id() == m_MainThread;
+
+	std::unique_lock<std::mutex> lock(m_Mutex);
+
+	while (true)
+	{
+		m_Condition.wait(lock, [&]()
+		{
+			return IsFinished() || (!m_Error && (!m_ReadyTasks.empty() || (main_thread && !m_ReadyMainTasks.empty())));
+		});
+
+		if (IsFinished())
+			return;
+
+		// The main thread takes its own tasks first, nobody else can
+		std::deque<uint32_t>& queue = main_thread && !m_ReadyMainTasks.empty() ? m_ReadyMainTasks : m_ReadyTasks;
+		uint32_t index = queue.front();
+		queue.pop_front();
+
+		Task& task = m_Tasks[index];
+		m_RunningCount++;
+		lock.unlock();
+
+		std::exception_ptr error;
+		auto start = Clock::now();
+
+		try
+		{
+			TraceScope scope(task.Name);
+			task.Function();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		auto end = Clock::now();
+
+		lock.lock();
+		m_RunningCount--;
+		m_FinishedCount++;
+
+		task.StartMs = std::chrono::duration<double, std::milli>(start - m_Start).count();
+		task.EndMs = std::chrono::duration<double, std::milli>(end - m_Start).count();
+
+		if (error)
+		{
+			if (!m_Error)
+				m_Error = error;
+		}
+		else
+		{
+			for (uint32_t dependent : task.Dependents)
+			{
+				Task& next = m_Tasks[dependent];
+
+				if (--next.PendingDependencies == 0)
+					(next.Thread == TaskThread::Main ? m_ReadyMainTasks : m_ReadyTasks).push_back(dependent);
+			}
+		}
+
+		m_Condition.notify_all();
+	}
+}
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "TimelineQueue.h"
+#include "VulkanResult.h"
+
+void TimelineQueue::Init(VkDevice device, const VkAllocationCallbacks* allocator, VkQueue queue)
+{
+	m_Device = device;
+	m_Allocator = allocator;
+	m_Queue = queue;
+
+	m_WaitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(m_Device, "vkWaitSemaphoresKHR"));
+	m_GetSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(m_Device, "vkGetSemaphoreCounterValueKHR"));
+
+	if (!m_WaitSemaphores || !m_GetSemaphoreCounterValue)
+		throw std::runtime_error("Failed to load the VK_KHR_timeline_semaphore functions.");
+
+	VkSemaphoreTypeCreateInfoKHR type_info = {};
+	type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	type_info.initialValue = 0;
+
+	VkSemaphoreCreateInfo create_info = {};
+	create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	create_info.pNext = &type_info;
+
+	VkResult result = vkCreateSemaphore(m_Device, &create_info, m_Allocator, &m_Semaphore);
+	check_vk_result(result);
+
+	m_LastSubmitted = 0;
+	m_Completed = 0;
+}
+
+void TimelineQueue::Destroy()
+{
+	if (m_Semaphore == VK_NULL_HANDLE)
+		return;
+
+	vkDestroySemaphore(m_Device, m_Semaphore, m_Allocator);
+	m_Semaphore = VK_NULL_HANDLE;
+}
+
+uint64_t TimelineQueue::Submit(const TimelineSubmitInfo& info)
+{
+	m_SubmitWaitSemaphores.clear();
+	m_SubmitWaitValues.clear();
+	m_SubmitWaitStages.clear();
+
+	// Binary semaphores take a value too, it's ignored
+	if (info.WaitSemaphore != VK_NULL_HANDLE)
+	{
+		m_SubmitWaitSemaphores.push_back(info.WaitSemaphore);
+		m_SubmitWaitValues.push_back(0);
+		m_SubmitWaitStages.push_back(info.WaitSemaphoreStage);
+	}
+
+	for (const TimelinePoint& point : info.WaitPoints)
+	{
+		m_SubmitWaitSemaphores.push_back(point.Semaphore);
+		m_SubmitWaitValues.push_back(point.Value);
+		m_SubmitWaitStages.push_back(info.WaitPointStage);
+	}
+
+	const uint64_t value = m_LastSubmitted + 1;
+
+	VkSemaphore signal_semaphores[2] = { m_Semaphore, info.SignalSemaphore };
+	uint64_t signal_values[2] = { value, 0 };
+	uint32_t signal_count = info.SignalSemaphore != VK_NULL_HANDLE ? 2 : 1;
+
+	VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+	timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timeline_info.waitSemaphoreValueCount = static_cast<uint32_t>(m_SubmitWaitValues.size());
+	timeline_info.pWaitSemaphoreValues = m_SubmitWaitValues.data();
+	timeline_info.signalSemaphoreValueCount = signal_count;
+	timeline_info.pSignalSemaphoreValues = signal_values;
+
+	VkSubmitInfo submit_info = {};
+	submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submit_info.pNext = &timeline_info;
+	submit_info.waitSemaphoreCount = static_cast<uint32_t>(m_SubmitWaitSemaphores.size());
+	submit_info.pWaitSemaphores = m_SubmitWaitSemaphores.data();
+	submit_info.pWaitDstStageMask = m_SubmitWaitStages.data();
+	submit_info.commandBufferCount = static_cast<uint32_t>(info.CommandBuffers.size());
+	submit_info.pCommandBuffers = info.CommandBuffers.data();
+	submit_info.signalSemaphoreCount = signal_count;
+	submit_info.pSignalSemaphores = signal_semaphores;
+
+	VkResult result = vkQueueSubmit(m_Queue, 1, &submit_info, VK_NULL_HANDLE);
+	check_vk_result(result);
+
+	m_LastSubmitted = value;
+	m_Stats.SubmitCount++;
+
+	return value;
+}
+
+uint64_t TimelineQueue::Poll()
+{
+	uint64_t value = 0;
+
+	VkResult result = m_GetSemaphoreCounterValue(m_Device, m_Semaphore, &value);
+	check_vk_result(result);
+
+	m_Completed = std::max(m_Completed, value);
+	m_Stats.CounterQueryCount++;
+
+	return m_Completed;
+}
+
+bool TimelineQueue::IsComplete(uint64_t value)
+{
+	return value <= m_Completed || value <= Poll();
+}
+
+bool TimelineQueue::Wait(uint64_t value, uint64_t timeout)
+{
+	m_Stats.WaitCount++;
+
+	// Most waits are for frames that finished long ago
+	if (value <= m_Completed)
+		return true;
+
+	m_Stats.BlockingWaitCount++;
+
+	VkSemaphoreWaitInfoKHR wait_info = {};
+	wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	wait_info.semaphoreCount = 1;
+	wait_info.pSemaphores = &m_Semaphore;
+	wait_info.pValues = &value;
+
+	VkResult result = m_WaitSemaphores(m_Device, &wait_info, timeout);
+
+	if (result == VK_TIMEOUT)
+		return false;
+
+	check_vk_result(result);
+
+	m_Completed = std::max(m_Completed, value);
+
+	return true;
+}
@@ -0,0 +1,227 @@
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "Tracer.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+
+// Process ids of the two groups of tracks in the trace
+const uint32_t TRACE_CPU_PROCESS = 1;
+const uint32_t TRACE_GPU_PROCESS = 2;
+
+static void WriteEscaped(std::ofstream& file, const char* text)
+{
+	for (const char* c = text; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+			file << '\\';
+
+		file << *c;
+	}
+}
+
+static void WriteEvent(std::ofstream& file, const TraceEvent& event, uint32_t thread_id, uint64_t start_time)
+{
+	// Chrome traces count in microseconds, GPU zones can start before the tracer did
+	double begin = (static_cast<int64_t>(event.Begin - start_time)) * 1e-3;
+	double duration = (event.End - event.Begin) * 1e-3;
+
+	file << ",\n{\"name\":\"";
+	WriteEscaped(file, event.Name);
+	file << "\",\"ph\":\"X\",\"pid\":" << (event.Gpu ? TRACE_GPU_PROCESS : TRACE_CPU_PROCESS) << ",\"tid\":" << (event.Gpu ? 1 : thread_id)
+		<< ",\"ts\":" << begin << ",\"dur\":" << duration << "}";
+}
+
+static void WriteMetadata(std::ofstream& file, const char* type, uint32_t process_id, uint32_t thread_id, const std::string& name)
+{
+	file << "{\"name\":\"" << type << "\",\"ph\":\"M\",\"pid\":" << process_id << ",\"tid\":" << thread_id << ",\"args\":{\"name\":\"";
+	WriteEscaped(file, name.c_str());
+	file << "\"}}";
+}
+
+Tracer& Tracer::Get()
+{
+	static Tracer tracer;
+	return tracer;
+}
+
+Tracer::~Tracer()
+{
+	for (ThreadBuffer* buffer : m_Buffers)
+	{
+		Chunk* chunk = buffer->Head;
+
+		while (chunk)
+		{
+			Chunk* next = chunk->Next.load(std::memory_order_relaxed);
+			delete chunk;
+			chunk = next;
+		}
+
+		delete buffer;
+	}
+}
+
+void Tracer::Enable()
+{
+#ifndef DISABLE_TRACING
+	if (m_StartTime == 0)
+		m_StartTime = Now();
+
+	s_Enabled.store(true, std::memory_order_relaxed);
+#endif
+}
+
+void Tracer::Disable()
+{
+#ifndef DISABLE_TRACING
+	s_Enabled.store(false, std::memory_order_relaxed);
+#endif
+}
+
+uint64_t Tracer::Now()
+{
+#ifdef _WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+
+	return HostTicksToNanoseconds(static_cast<uint64_t>(counter.QuadPart));
+#else
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return static_cast<uint64_t>(time.tv_sec) * 1000000000ull + static_cast<uint64_t>(time.tv_nsec);
+#endif
+}
+
+uint64_t Tracer::HostTicksToNanoseconds(uint64_t ticks)
+{
+#ifdef _WIN32
+	static const uint64_t frequency = []()
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		return static_cast<uint64_t>(frequency.QuadPart);
+	}();
+
+	// Split up so the multiplication doesn't overflow
+	return ticks / frequency * 1000000000ull + ticks % frequency * 1000000000ull / frequency;
+#else
+	return ticks;
+#endif
+}
+
+void Tracer::AddZone(const char* name, uint64_t begin, uint64_t end)
+{
+	Record({ name, begin, end, false });
+}
+
+void Tracer::AddGpuZone(const char* name, uint64_t begin, uint64_t end)
+{
+	Record({ name, begin, end, true });
+}
+
+void Tracer::SetThreadName(const std::string& name)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	buffer->Name = name;
+}
+
+Tracer::ThreadBuffer* Tracer::GetThreadBuffer()
+{
+	thread_local ThreadBuffer* t_Buffer = nullptr;
+
+	if (t_Buffer)
+		return t_Buffer;
+
+	ThreadBuffer* buffer = new ThreadBuffer();
+	buffer->Head = new Chunk();
+	buffer->Tail = buffer->Head;
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+
+		m_Buffers.push_back(buffer);
+		buffer->ThreadId = static_cast<uint32_t>(m_Buffers.size());
+		buffer->Name = "Thread " + std::to_string(buffer->ThreadId);
+	}
+
+	t_Buffer = buffer;
+
+	return buffer;
+}
+
+void Tracer::Record(const TraceEvent& event)
+{
+	ThreadBuffer* buffer = GetThreadBuffer();
+	Chunk* chunk = buffer->Tail;
+
+	uint32_t count = chunk->Count.load(std::memory_order_relaxed);
+
+	// Full, link a new chunk, the writer only ever reads published chunks and counts
+	if (count == TRACE_CHUNK_SIZE)
+	{
+		Chunk* next = new Chunk();
+		chunk->Next.store(next, std::memory_order_release);
+
+		buffer->Tail = next;
+		chunk = next;
+		count = 0;
+	}
+
+	chunk->Events[count] = event;
+	chunk->Count.store(count + 1, std::memory_order_release);
+}
+
+uint64_t Tracer::WriteChromeTrace(const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::trunc);
+
+	if (!file.is_open())
+		throw std::runtime_error("Failed to create trace file " + filename + ".");
+
+	std::lock_guard<std::mutex> lock(m_Mutex);
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+	WriteMetadata(file, "process_name", TRACE_CPU_PROCESS, 0, "CPU");
+	file << ",\n";
+	WriteMetadata(file, "process_name", TRACE_GPU_PROCESS, 0, "GPU");
+	file << ",\n";
+	WriteMetadata(file, "thread_name", TRACE_GPU_PROCESS, 1, "Graphics Queue");
+
+	uint64_t event_count = 0;
+
+	for (const ThreadBuffer* buffer : m_Buffers)
+	{
+		file << ",\n";
+		WriteMetadata(file, "thread_name", TRACE_CPU_PROCESS, buffer->ThreadId, buffer->Name);
+
+		for (const Chunk* chunk = buffer->Head; chunk; chunk = chunk->Next.load(std::memory_order_acquire))
+		{
+			uint32_t count = chunk->Count.load(std::memory_order_acquire);
+
+			for (uint32_t i = 0; i < count; i++)
+			{
+				WriteEvent(file, chunk->Events[i], buffer->ThreadId, m_StartTime);
+			}
+
+			event_count += count;
+		}
+	}
+
+	file << "\n]}\n";
+
+	return event_count;
+}
@@ -0,0 +1,317 @@
+// Offline asset packer, writes every file below a directory into one asset archive (see AssetArchive.h).
+//
+// Usage: AssetPacker <asset directory> <output.pak> [--compress lz4|zstd] [--benchmark]
+//
+// Entry names are the paths relative to the asset directory with '/' as separator, e.g.
+// packing "assets" stores "assets/shaders/vert.spv" as "shaders/vert.spv".
+//
+// --benchmark compares loading every asset through the archive against opening and reading
+// every loose file (the std::ifstream path the engine used before). The first pass is only
+// a cold load if the OS file cache was dropped before running the tool.
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "AssetArchive.h"
+
+#ifdef ASSET_ARCHIVE_LZ4
+#include <lz4hc.h>
+#endif
+
+#ifdef ASSET_ARCHIVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Compressed data is only kept if it saves at least this much
+const double MIN_COMPRESSION_RATIO = 0.9;
+
+const int BENCHMARK_PASSES = 5;
+
+struct PackedAsset
+{
+	std::string Name;
+	std::filesystem::path Path;
+	std::vector<uint8_t> Data;
+	uint64_t UncompressedSize = 0;
+	AssetCompression Compression = AssetCompression::None;
+};
+
+using Clock = std::chrono::high_resolution_clock;
+
+static std::vector<uint8_t> ReadBinaryFile(const std::filesystem::path& path)
+{
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open file.");
+	}
+
+	std::vector<uint8_t> buffer(static_cast<size_t>(file.tellg()));
+
+	file.seekg(0);
+	file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+
+	return buffer;
+}
+
+static void Compress(PackedAsset& asset, AssetCompression compression)
+{
+	std::vector<uint8_t> compressed;
+
+	switch (compression)
+	{
+#ifdef ASSET_ARCHIVE_LZ4
+	case AssetCompression::LZ4:
+	{
+		compressed.resize(LZ4_compressBound(static_cast<int>(asset.Data.size())));
+		int size = LZ4_compress_HC(reinterpret_cast<const char*>(asset.Data.data()), reinterpret_cast<char*>(compressed.data()), static_cast<int>(asset.Data.size()), static_cast<int>(compressed.size()), LZ4HC_CLEVEL_MAX);
+
+		if (size <= 0)
+			return;
+
+		compressed.resize(size);
+		break;
+	}
+#endif
+
+#ifdef ASSET_ARCHIVE_ZSTD
+	case AssetCompression::Zstd:
+	{
+		compressed.resize(ZSTD_compressBound(asset.Data.size()));
+		size_t size = ZSTD_compress(compressed.data(), compressed.size(), asset.Data.data(), asset.Data.size(), 19);
+
+		if (ZSTD_isError(size))
+			return;
+
+		compressed.resize(size);
+		break;
+	}
+#endif
+
+	default:
+		return;
+	}
+
+	if (compressed.size() < asset.Data.size() * MIN_COMPRESSION_RATIO)
+	{
+		asset.Data = std::move(compressed);
+		asset.Compression = compression;
+	}
+}
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + ASSET_ARCHIVE_ALIGNMENT - 1) & ~static_cast<uint64_t>(ASSET_ARCHIVE_ALIGNMENT - 1);
+}
+
+static void WriteArchive(const std::string& filename, std::vector<PackedAsset>& assets)
+{
+	std::sort(assets.begin(), assets.end(), [](const PackedAsset& a, const PackedAsset& b)
+	{
+		return HashAssetName(a.Name) < HashAssetName(b.Name);
+	});
+
+	AssetArchiveHeader header = {};
+	header.Magic = ASSET_ARCHIVE_MAGIC;
+	header.Version = ASSET_ARCHIVE_VERSION;
+	header.EntryCount = static_cast<uint32_t>(assets.size());
+	header.Alignment = ASSET_ARCHIVE_ALIGNMENT;
+	header.EntryOffset = sizeof(AssetArchiveHeader);
+	header.NameOffset = header.EntryOffset + assets.size() * sizeof(AssetArchiveEntry);
+
+	std::vector<AssetArchiveEntry> entries(assets.size());
+	std::string names;
+
+	for (size_t i = 0; i < assets.size(); i++)
+	{
+		entries[i] = {};
+		entries[i].NameHash = HashAssetName(assets[i].Name);
+		entries[i].NameOffset = static_cast<uint32_t>(names.size());
+		entries[i].NameLength = static_cast<uint32_t>(assets[i].Name.size());
+		entries[i].Size = assets[i].Data.size();
+		entries[i].UncompressedSize = assets[i].UncompressedSize;
+		entries[i].Compression = assets[i].Compression;
+
+		names += assets[i].Name;
+	}
+
+	header.NameSize = names.size();
+
+	uint64_t offset = header.NameOffset + header.NameSize;
+
+	for (AssetArchiveEntry& entry : entries)
+	{
+		entry.Offset = AlignOffset(offset);
+		offset = entry.Offset + entry.Size;
+	}
+
+	std::vector<uint8_t> file_data(offset, 0);
+	std::memcpy(file_data.data(), &header, sizeof(header));
+	std::memcpy(file_data.data() + header.EntryOffset, entries.data(), entries.size() * sizeof(AssetArchiveEntry));
+	std::memcpy(file_data.data() + header.NameOffset, names.data(), names.size());
+
+	for (size_t i = 0; i < assets.size(); i++)
+	{
+		std::memcpy(file_data.data() + entries[i].Offset, assets[i].Data.data(), assets[i].Data.size());
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open file.");
+	}
+
+	file.write(reinterpret_cast<const char*>(file_data.data()), file_data.size());
+}
+
+static double Checksum(std::span<const uint8_t> data)
+{
+	// Touch every page so the mapping actually gets read
+	double sum = 0.0;
+
+	for (size_t i = 0; i < data.size(); i += 4096)
+	{
+		sum += data[i];
+	}
+
+	return sum;
+}
+
+static void Benchmark(const std::string& archive_filename, const std::vector<PackedAsset>& assets)
+{
+	for (int pass = 0; pass < BENCHMARK_PASSES; pass++)
+	{
+		double checksum = 0.0;
+
+		auto archive_start = Clock::now();
+		{
+			AssetArchive archive(archive_filename);
+			std::vector<uint8_t> storage;
+
+			for (const PackedAsset& asset : assets)
+			{
+				checksum += Checksum(archive.Load(asset.Name, storage));
+			}
+		}
+		double archive_ms = std::chrono::duration<double, std::milli>(Clock::now() - archive_start).count();
+
+		auto loose_start = Clock::now();
+		for (const PackedAsset& asset : assets)
+		{
+			std::vector<uint8_t> data = ReadBinaryFile(asset.Path);
+			checksum += Checksum(data);
+		}
+		double loose_ms = std::chrono::duration<double, std::milli>(Clock::now() - loose_start).count();
+
+		std::cout << (pass == 0 ? "First" : "Warm ") << " pass: archive " << archive_ms << " ms, loose files " << loose_ms << " ms"
+			<< " (" << assets.size() << " assets, checksum " << checksum << ")" << std::endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* usage = "Usage: AssetPacker <asset directory> <output.pak> [--compress lz4|zstd] [--benchmark]";
+
+	if (argc < 3)
+	{
+		std::cout << usage << std::endl;
+		return 1;
+	}
+
+	AssetCompression compression = AssetCompression::None;
+	bool benchmark = false;
+
+	for (int i = 3; i < argc; i++)
+	{
+		std::string argument = argv[i];
+
+		if (argument == "--compress" && i + 1 < argc)
+		{
+			std::string codec = argv[++i];
+
+			if (codec == "lz4")
+			{
+				compression = AssetCompression::LZ4;
+			}
+			else if (codec == "zstd")
+			{
+				compression = AssetCompression::Zstd;
+			}
+			else
+			{
+				std::cout << "Unknown codec \"" << codec << "\". " << usage << std::endl;
+				return 1;
+			}
+		}
+		else if (argument == "--compress")
+		{
+			std::cout << "Missing codec. " << usage << std::endl;
+			return 1;
+		}
+		else if (argument == "--benchmark")
+		{
+			benchmark = true;
+		}
+	}
+
+	try
+	{
+#ifndef ASSET_ARCHIVE_LZ4
+		if (compression == AssetCompression::LZ4)
+			throw std::runtime_error("LZ4 support is not compiled in (ASSET_ARCHIVE_LZ4).");
+#endif
+
+#ifndef ASSET_ARCHIVE_ZSTD
+		if (compression == AssetCompression::Zstd)
+			throw std::runtime_error("Zstd support is not compiled in (ASSET_ARCHIVE_ZSTD).");
+#endif
+
+		std::filesystem::path root = argv[1];
+		std::filesystem::path output = std::filesystem::absolute(argv[2]);
+		std::vector<PackedAsset> assets;
+		uint64_t total_size = 0;
+		uint64_t packed_size = 0;
+
+		for (const auto& file : std::filesystem::recursive_directory_iterator(root))
+		{
+			if (!file.is_regular_file() || std::filesystem::absolute(file.path()) == output)
+				continue;
+
+			PackedAsset asset;
+			asset.Name = std::filesystem::relative(file.path(), root).generic_string();
+			asset.Path = file.path();
+			asset.Data = ReadBinaryFile(file.path());
+			asset.UncompressedSize = asset.Data.size();
+
+			Compress(asset, compression);
+
+			total_size += asset.UncompressedSize;
+			packed_size += asset.Data.size();
+
+			assets.push_back(std::move(asset));
+		}
+
+		WriteArchive(argv[2], assets);
+
+		std::cout << "Wrote " << argv[2] << ": " << assets.size() << " assets, " << total_size << " bytes -> " << packed_size << " bytes" << std::endl;
+
+		if (benchmark)
+			Benchmark(argv[2], assets);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,649 @@
+// Offline mesh optimizer, converts Wavefront OBJ files into the binary mesh format (see MeshFormat.h).
+//
+// Usage: MeshOptimizer <input.obj> <output.mesh> [lod count]
+//
+// - Generates a LOD chain by vertex clustering
+// - Reorders the indices of every LOD for the post-transform vertex cache (Forsyth)
+// - Reorders the vertices in order of first use for fetch locality
+// - Quantizes positions, normals and texture coordinates
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MeshFormat.h"
+
+// Vertex cache model used for the optimization
+const int CACHE_SIZE = 32;
+
+// Each LOD halves the clustering grid until the triangle count stops dropping
+const uint32_t LOD_BASE_GRID_SIZE = 256;
+const float LOD_MIN_REDUCTION = 0.85f;
+
+struct Vertex
+{
+	float Position[3];
+	float Normal[3];
+	float TexCoord[2];
+};
+
+struct Lod
+{
+	std::vector<uint32_t> Indices;
+	float Error = 0.0f;
+};
+
+static std::vector<Vertex> s_Vertices;
+static std::vector<uint32_t> s_Indices;
+
+static int ResolveObjIndex(int index, size_t count)
+{
+	// OBJ indices are 1 based, negative values are relative to the end
+	return index < 0 ? static_cast<int>(count) + index : index - 1;
+}
+
+static void LoadObj(const std::string& filename)
+{
+	std::ifstream file(filename);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open file.");
+	}
+
+	std::vector<std::array<float, 3>> positions;
+	std::vector<std::array<float, 3>> normals;
+	std::vector<std::array<float, 2>> tex_coords;
+
+	// Unique position/texcoord/normal combinations
+	std::unordered_map<uint64_t, uint32_t> vertex_lookup;
+	bool has_normals = true;
+
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		std::string type;
+		stream >> type;
+
+		if (type == "v")
+		{
+			std::array<float, 3> p = {};
+			stream >> p[0] >> p[1] >> p[2];
+			positions.push_back(p);
+		}
+		else if (type == "vn")
+		{
+			std::array<float, 3> n = {};
+			stream >> n[0] >> n[1] >> n[2];
+			normals.push_back(n);
+		}
+		else if (type == "vt")
+		{
+			std::array<float, 2> t = {};
+			stream >> t[0] >> t[1];
+			tex_coords.push_back(t);
+		}
+		else if (type == "f")
+		{
+			std::vector<uint32_t> polygon;
+			std::string corner;
+
+			while (stream >> corner)
+			{
+				int p = 0, t = 0, n = 0;
+
+				// v, v/vt, v//vn, v/vt/vn
+				if (sscanf(corner.c_str(), "%d/%d/%d", &p, &t, &n) != 3 &&
+					sscanf(corner.c_str(), "%d//%d", &p, &n) != 2 &&
+					sscanf(corner.c_str(), "%d/%d", &p, &t) != 2)
+				{
+					sscanf(corner.c_str(), "%d", &p);
+				}
+
+				int position = ResolveObjIndex(p, positions.size());
+				int tex_coord = t != 0 ? ResolveObjIndex(t, tex_coords.size()) : -1;
+				int normal = n != 0 ? ResolveObjIndex(n, normals.size()) : -1;
+
+				if (position < 0 || position >= (int)positions.size() || tex_coord >= (int)tex_coords.size() || normal >= (int)normals.size())
+					throw std::runtime_error("Invalid face index in " + filename);
+
+				has_normals &= normal >= 0;
+
+				uint64_t key = (static_cast<uint64_t>(position) << 42) ^ (static_cast<uint64_t>(tex_coord + 1) << 21) ^ static_cast<uint64_t>(normal + 1);
+				auto it = vertex_lookup.find(key);
+
+				if (it == vertex_lookup.end())
+				{
+					Vertex vertex = {};
+					std::memcpy(vertex.Position, positions[position].data(), sizeof(vertex.Position));
+
+					if (normal >= 0)
+						std::memcpy(vertex.Normal, normals[normal].data(), sizeof(vertex.Normal));
+
+					if (tex_coord >= 0)
+						std::memcpy(vertex.TexCoord, tex_coords[tex_coord].data(), sizeof(vertex.TexCoord));
+
+					it = vertex_lookup.emplace(key, static_cast<uint32_t>(s_Vertices.size())).first;
+					s_Vertices.push_back(vertex);
+				}
+
+				polygon.push_back(it->second);
+			}
+
+			// Triangle fan
+			for (size_t i = 2; i < polygon.size(); i++)
+			{
+				s_Indices.push_back(polygon[0]);
+				s_Indices.push_back(polygon[i - 1]);
+				s_Indices.push_back(polygon[i]);
+			}
+		}
+	}
+
+	if (s_Indices.empty())
+		throw std::runtime_error("No triangles found in " + filename);
+
+	// Area weighted face normals
+	if (!has_normals)
+	{
+		for (Vertex& vertex : s_Vertices)
+		{
+			vertex.Normal[0] = vertex.Normal[1] = vertex.Normal[2] = 0.0f;
+		}
+
+		for (size_t i = 0; i < s_Indices.size(); i += 3)
+		{
+			const float* a = s_Vertices[s_Indices[i + 0]].Position;
+			const float* b = s_Vertices[s_Indices[i + 1]].Position;
+			const float* c = s_Vertices[s_Indices[i + 2]].Position;
+
+			float e0[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e1[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+
+			for (size_t j = 0; j < 3; j++)
+			{
+				float* normal = s_Vertices[s_Indices[i + j]].Normal;
+				normal[0] += n[0];
+				normal[1] += n[1];
+				normal[2] += n[2];
+			}
+		}
+	}
+
+	for (Vertex& vertex : s_Vertices)
+	{
+		float* n = vertex.Normal;
+		float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+		if (length > 0.0f)
+		{
+			n[0] /= length;
+			n[1] /= length;
+			n[2] /= length;
+		}
+		else
+		{
+			n[0] = 0.0f;
+			n[1] = 0.0f;
+			n[2] = 1.0f;
+		}
+	}
+}
+
+// Average cache miss ratio (vertex shader invocations per triangle) of a FIFO cache
+static float CalculateACMR(const std::vector<uint32_t>& indices, size_t cache_size)
+{
+	std::vector<uint32_t> cache;
+	size_t misses = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (std::find(cache.begin(), cache.end(), index) == cache.end())
+		{
+			misses++;
+			cache.insert(cache.begin(), index);
+
+			if (cache.size() > cache_size)
+				cache.pop_back();
+		}
+	}
+
+	return indices.empty() ? 0.0f : static_cast<float>(misses) / (indices.size() / 3);
+}
+
+// Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static float VertexScore(int cache_position, uint32_t remaining_triangles)
+{
+	if (remaining_triangles == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+
+	if (cache_position >= 0)
+	{
+		// The last triangle's vertices get a fixed score so they aren't favoured too much
+		if (cache_position < 3)
+		{
+			score = 0.75f;
+		}
+		else
+		{
+			float scale = 1.0f / (CACHE_SIZE - 3);
+			score = std::pow(1.0f - (cache_position - 3) * scale, 1.5f);
+		}
+	}
+
+	// Favour vertices with few remaining triangles to get rid of lone triangles early
+	score += 2.0f * std::pow(static_cast<float>(remaining_triangles), -0.5f);
+
+	return score;
+}
+
+static std::vector<uint32_t> OptimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertex_count)
+{
+	const size_t triangle_count = indices.size() / 3;
+
+	// Vertex to triangle adjacency
+	std::vector<uint32_t> remaining(vertex_count, 0);
+
+	for (uint32_t index : indices)
+	{
+		remaining[index]++;
+	}
+
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+
+	for (size_t i = 0; i < vertex_count; i++)
+	{
+		offsets[i + 1] = offsets[i] + remaining[i];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		adjacency[cursor[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+
+	for (size_t i = 0; i < vertex_count; i++)
+	{
+		vertex_score[i] = VertexScore(-1, remaining[i]);
+	}
+
+	std::vector<float> triangle_score(triangle_count);
+	std::vector<bool> emitted(triangle_count, false);
+
+	for (size_t i = 0; i < triangle_count; i++)
+	{
+		triangle_score[i] = vertex_score[indices[i * 3]] + vertex_score[indices[i * 3 + 1]] + vertex_score[indices[i * 3 + 2]];
+	}
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> new_cache;
+
+	size_t best_triangle = 0;
+	size_t scan_cursor = 0;
+
+	for (size_t i = 1; i < triangle_count; i++)
+	{
+		if (triangle_score[i] > triangle_score[best_triangle])
+			best_triangle = i;
+	}
+
+	while (result.size() < indices.size())
+	{
+		const uint32_t* triangle = &indices[best_triangle * 3];
+		emitted[best_triangle] = true;
+
+		result.insert(result.end(), triangle, triangle + 3);
+
+		// Move the triangle's vertices to the front of the cache
+		new_cache.assign(triangle, triangle + 3);
+
+		for (uint32_t vertex : cache)
+		{
+			if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2])
+				new_cache.push_back(vertex);
+		}
+
+		for (size_t j = 0; j < 3; j++)
+		{
+			uint32_t vertex = triangle[j];
+			uint32_t* begin = &adjacency[offsets[vertex]];
+			uint32_t* end = begin + remaining[vertex];
+
+			std::remove(begin, end, static_cast<uint32_t>(best_triangle));
+			remaining[vertex]--;
+		}
+
+		// Vertices pushed out of the cache lose their cache score
+		for (size_t j = CACHE_SIZE; j < new_cache.size(); j++)
+		{
+			cache_position[new_cache[j]] = -1;
+			vertex_score[new_cache[j]] = VertexScore(-1, remaining[new_cache[j]]);
+		}
+
+		if (new_cache.size() > CACHE_SIZE)
+			new_cache.resize(CACHE_SIZE);
+
+		std::swap(cache, new_cache);
+
+		for (size_t j = 0; j < cache.size(); j++)
+		{
+			cache_position[cache[j]] = static_cast<int>(j);
+			vertex_score[cache[j]] = VertexScore(static_cast<int>(j), remaining[cache[j]]);
+		}
+
+		// Only triangles touching the cache changed their score
+		float best_score = -1.0f;
+		size_t next_triangle = triangle_count;
+
+		for (uint32_t vertex : cache)
+		{
+			for (uint32_t j = 0; j < remaining[vertex]; j++)
+			{
+				uint32_t t = adjacency[offsets[vertex] + j];
+				const uint32_t* v = &indices[t * 3];
+
+				triangle_score[t] = vertex_score[v[0]] + vertex_score[v[1]] + vertex_score[v[2]];
+
+				if (triangle_score[t] > best_score)
+				{
+					best_score = triangle_score[t];
+					next_triangle = t;
+				}
+			}
+		}
+
+		// Nothing left around the cache, continue with the next unused triangle
+		if (next_triangle == triangle_count)
+		{
+			while (scan_cursor < triangle_count && emitted[scan_cursor])
+			{
+				scan_cursor++;
+			}
+
+			next_triangle = scan_cursor;
+		}
+
+		best_triangle = next_triangle;
+	}
+
+	return result;
+}
+
+// Snaps vertices to a grid and keeps one representative vertex per cell
+static Lod SimplifyByClustering(const std::vector<uint32_t>& indices, uint32_t grid_size, const float* bounds_min, const float* bounds_max)
+{
+	float extent[3];
+
+	for (int i = 0; i < 3; i++)
+	{
+		extent[i] = std::max(bounds_max[i] - bounds_min[i], 1e-6f);
+	}
+
+	std::unordered_map<uint64_t, uint32_t> cells;
+	std::vector<uint32_t> remap(s_Vertices.size(), UINT32_MAX);
+
+	for (uint32_t index : indices)
+	{
+		if (remap[index] != UINT32_MAX)
+			continue;
+
+		const float* p = s_Vertices[index].Position;
+		uint64_t cell = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			uint64_t coordinate = static_cast<uint64_t>((p[i] - bounds_min[i]) / extent[i] * (grid_size - 1) + 0.5f);
+			cell = (cell << 21) | coordinate;
+		}
+
+		remap[index] = cells.emplace(cell, index).first->second;
+	}
+
+	Lod lod;
+	// A cell diagonal, relative to the bounds diagonal
+	lod.Error = 1.0f / grid_size;
+
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		uint32_t a = remap[indices[i + 0]];
+		uint32_t b = remap[indices[i + 1]];
+		uint32_t c = remap[indices[i + 2]];
+
+		// Drop collapsed triangles
+		if (a == b || b == c || a == c)
+			continue;
+
+		lod.Indices.push_back(a);
+		lod.Indices.push_back(b);
+		lod.Indices.push_back(c);
+	}
+
+	return lod;
+}
+
+static uint16_t QuantizeUnorm16(float value)
+{
+	value = std::clamp(value, 0.0f, 1.0f);
+	return static_cast<uint16_t>(value * 65535.0f + 0.5f);
+}
+
+static int8_t QuantizeSnorm8(float value)
+{
+	value = std::clamp(value, -1.0f, 1.0f);
+	return static_cast<int8_t>(std::round(value * 127.0f));
+}
+
+static uint16_t QuantizeHalf(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent <= 0)
+		return static_cast<uint16_t>(sign);
+
+	if (exponent >= 31)
+		return static_cast<uint16_t>(sign | 0x7C00);
+
+	// Round to nearest
+	uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+
+	if (mantissa & 0x1000)
+		half++;
+
+	return static_cast<uint16_t>(half);
+}
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + MESH_FILE_ALIGNMENT - 1) & ~static_cast<uint64_t>(MESH_FILE_ALIGNMENT - 1);
+}
+
+static void WriteMesh(const std::string& filename, const std::vector<Lod>& lods, const float* bounds_min, const float* bounds_max)
+{
+	MeshFileHeader header = {};
+	header.Magic = MESH_FILE_MAGIC;
+	header.Version = MESH_FILE_VERSION;
+	header.VertexStride = sizeof(MeshVertex);
+	header.VertexCount = static_cast<uint32_t>(s_Vertices.size());
+	header.LodCount = static_cast<uint32_t>(lods.size());
+
+	std::vector<MeshFileLod> lod_table(lods.size());
+	std::vector<uint32_t> indices;
+
+	for (size_t i = 0; i < lods.size(); i++)
+	{
+		lod_table[i] = {};
+		lod_table[i].FirstIndex = static_cast<uint32_t>(indices.size());
+		lod_table[i].IndexCount = static_cast<uint32_t>(lods[i].Indices.size());
+		lod_table[i].Error = lods[i].Error;
+
+		indices.insert(indices.end(), lods[i].Indices.begin(), lods[i].Indices.end());
+	}
+
+	header.IndexCount = static_cast<uint32_t>(indices.size());
+
+	std::vector<MeshVertex> vertices(s_Vertices.size());
+
+	for (size_t i = 0; i < s_Vertices.size(); i++)
+	{
+		const Vertex& source = s_Vertices[i];
+		MeshVertex& vertex = vertices[i];
+
+		for (int j = 0; j < 3; j++)
+		{
+			float extent = std::max(bounds_max[j] - bounds_min[j], 1e-6f);
+			vertex.Position[j] = QuantizeUnorm16((source.Position[j] - bounds_min[j]) / extent);
+			vertex.Normal[j] = QuantizeSnorm8(source.Normal[j]);
+		}
+
+		vertex.Position[3] = 0;
+		vertex.Normal[3] = 0;
+		vertex.TexCoord[0] = QuantizeHalf(source.TexCoord[0]);
+		vertex.TexCoord[1] = QuantizeHalf(source.TexCoord[1]);
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		header.BoundsMin[i] = bounds_min[i];
+		header.BoundsMax[i] = bounds_max[i];
+	}
+
+	header.LodOffset = AlignOffset(sizeof(MeshFileHeader));
+	header.VertexOffset = AlignOffset(header.LodOffset + lod_table.size() * sizeof(MeshFileLod));
+	header.VertexSize = vertices.size() * sizeof(MeshVertex);
+	header.IndexOffset = AlignOffset(header.VertexOffset + header.VertexSize);
+	header.IndexSize = indices.size() * sizeof(uint32_t);
+
+	std::vector<uint8_t> file_data(header.IndexOffset + header.IndexSize, 0);
+	std::memcpy(file_data.data(), &header, sizeof(header));
+	std::memcpy(file_data.data() + header.LodOffset, lod_table.data(), lod_table.size() * sizeof(MeshFileLod));
+	std::memcpy(file_data.data() + header.VertexOffset, vertices.data(), header.VertexSize);
+	std::memcpy(file_data.data() + header.IndexOffset, indices.data(), header.IndexSize);
+
+	std::ofstream file(filename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Failed to open file.");
+	}
+
+	file.write(reinterpret_cast<const char*>(file_data.data()), file_data.size());
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 3)
+	{
+		std::cout << "Usage: MeshOptimizer <input.obj> <output.mesh> [lod count]" << std::endl;
+		return 1;
+	}
+
+	uint32_t max_lods = argc > 3 ? static_cast<uint32_t>(std::atoi(argv[3])) : MESH_FILE_MAX_LODS;
+	max_lods = std::clamp(max_lods, 1u, MESH_FILE_MAX_LODS);
+
+	try
+	{
+		LoadObj(argv[1]);
+
+		float bounds_min[3] = { INFINITY, INFINITY, INFINITY };
+		float bounds_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+		for (const Vertex& vertex : s_Vertices)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				bounds_min[i] = std::min(bounds_min[i], vertex.Position[i]);
+				bounds_max[i] = std::max(bounds_max[i], vertex.Position[i]);
+			}
+		}
+
+		// LOD chain
+		std::vector<Lod> lods(1);
+		lods[0].Indices = s_Indices;
+
+		for (uint32_t grid_size = LOD_BASE_GRID_SIZE; lods.size() < max_lods && grid_size >= 2; grid_size /= 2)
+		{
+			Lod lod = SimplifyByClustering(lods[0].Indices, grid_size, bounds_min, bounds_max);
+
+			if (lod.Indices.empty() || lod.Indices.size() > lods.back().Indices.size() * LOD_MIN_REDUCTION)
+				continue;
+
+			lods.push_back(std::move(lod));
+		}
+
+		// Post-transform vertex cache
+		for (size_t i = 0; i < lods.size(); i++)
+		{
+			float acmr_before = CalculateACMR(lods[i].Indices, 16);
+			lods[i].Indices = OptimizeVertexCache(lods[i].Indices, s_Vertices.size());
+			float acmr_after = CalculateACMR(lods[i].Indices, 16);
+
+			std::cout << "LOD " << i << ": " << lods[i].Indices.size() / 3 << " triangles, ACMR " << acmr_before << " -> " << acmr_after << std::endl;
+		}
+
+		// Vertex fetch, order of first use in LOD 0. Coarser LODs only reference a subset of these.
+		std::vector<uint32_t> remap(s_Vertices.size(), UINT32_MAX);
+		std::vector<Vertex> vertices;
+		vertices.reserve(s_Vertices.size());
+
+		for (const Lod& lod : lods)
+		{
+			for (uint32_t index : lod.Indices)
+			{
+				if (remap[index] == UINT32_MAX)
+				{
+					remap[index] = static_cast<uint32_t>(vertices.size());
+					vertices.push_back(s_Vertices[index]);
+				}
+			}
+		}
+
+		for (Lod& lod : lods)
+		{
+			for (uint32_t& index : lod.Indices)
+			{
+				index = remap[index];
+			}
+		}
+
+		s_Vertices = std::move(vertices);
+
+		WriteMesh(argv[2], lods, bounds_min, bounds_max);
+
+		std::cout << "Wrote " << argv[2] << ": " << s_Vertices.size() << " vertices, " << lods.size() << " LODs" << std::endl;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
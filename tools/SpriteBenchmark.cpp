@@ -0,0 +1,109 @@
+// Sprite batcher benchmark, measures the CPU side of the 2D path (sorting, batching and
+// writing the streamed vertices) for growing quad counts up to 1M quads per frame.
+//
+// Usage: SpriteBenchmark [max quads] [texture count]
+//
+// The quads get random textures, blend states and one of four layers, a worst case for the
+// batching compared to UI where neighbouring quads mostly share a texture atlas. The vertices
+// are written to plain heap memory, which is faster to write than the write-combined memory
+// of the mapped vertex buffer but shows the same scaling.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "JobSystem.h"
+#include "SpriteBatcher.h"
+
+// Frames per quad count, the first one is a warm-up and not counted
+const uint32_t BENCHMARK_FRAMES = 11;
+
+using Clock = std::chrono::high_resolution_clock;
+
+int main(int argc, char** argv)
+{
+	uint32_t max_quads = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1000000;
+	uint32_t texture_count = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 16;
+
+	if (max_quads == 0 || texture_count == 0)
+	{
+		std::cout << "Usage: SpriteBenchmark [max quads] [texture count]" << std::endl;
+		return 1;
+	}
+
+	JobSystem job_system;
+
+	SpriteBatcher batcher;
+	batcher.Reserve(max_quads);
+
+	std::vector<SpriteVertex> vertices(static_cast<size_t>(max_quads) * SPRITE_VERTICES_PER_QUAD);
+
+	// Same quads every frame, generating them isn't part of the measurement
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> position(0.0f, 1600.0f);
+	std::uniform_real_distribution<float> size(4.0f, 64.0f);
+
+	std::vector<SpriteQuad> quads(max_quads);
+
+	for (SpriteQuad& quad : quads)
+	{
+		quad.Position[0] = position(random);
+		quad.Position[1] = position(random);
+		quad.Size[0] = size(random);
+		quad.Size[1] = size(random);
+		quad.Color = random();
+		quad.Texture = random() % texture_count;
+		quad.Blend = static_cast<SpriteBlend>(random() % SPRITE_BLEND_COUNT);
+		quad.Layer = static_cast<uint16_t>(random() % 4);
+	}
+
+	std::cout << "[Sprites] " << texture_count << " textures, " << SPRITE_BLEND_COUNT << " blend states, 4 layers, "
+		<< job_system.GetThreadCount() << " threads" << std::endl;
+
+	for (uint32_t quad_count = std::min(1000u, max_quads); ; quad_count = std::min(quad_count * 10, max_quads))
+	{
+		double submit_ms = 0.0;
+		double sort_ms = 0.0;
+		double write_ms = 0.0;
+		double total_ms = 0.0;
+
+		for (uint32_t frame = 0; frame < BENCHMARK_FRAMES; frame++)
+		{
+			auto start = Clock::now();
+
+			for (uint32_t i = 0; i < quad_count; i++)
+			{
+				batcher.DrawQuad(quads[i]);
+			}
+
+			double frame_submit_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			batcher.Build(job_system, vertices.data(), max_quads);
+
+			if (frame == 0)
+				continue;
+
+			const SpriteBatchStats& stats = batcher.GetStats();
+			submit_ms += frame_submit_ms;
+			sort_ms += stats.SortMs;
+			write_ms += stats.WriteMs;
+			total_ms += frame_submit_ms + stats.TotalMs;
+		}
+
+		const double frames = BENCHMARK_FRAMES - 1;
+		const SpriteBatchStats& stats = batcher.GetStats();
+
+		std::cout << "[Sprites] " << quad_count << " quads: " << total_ms / frames << " ms per frame ("
+			<< submit_ms / frames << " submit, " << sort_ms / frames << " sort and batch, " << write_ms / frames << " vertex write), "
+			<< quad_count / (total_ms / frames) * 1e-3 << " M quads/s, " << stats.BatchCount << " draws instead of " << quad_count
+			<< ", " << stats.SortPasses << " radix passes" << std::endl;
+
+		if (quad_count == max_quads)
+			break;
+	}
+
+	return 0;
+}